@@ -31,11 +31,13 @@
  */
 #include "postgres.h"
 #include "access/hash.h"
+#include "funcapi.h"
 #include "libpq/pqformat.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
 #include "e164_base.h"
 #include "e164_area_codes.h"
+#include "e164_prefix.h"
 
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
@@ -44,12 +46,6 @@ PG_MODULE_MAGIC;
 /*
  * PostgreSQL Interface functions
  */
-#define DatumGetE164P(X) DatumGetInt64(X)
-#define E164PGetDatum(X) Int64GetDatum(X)
-
-#define PG_GETARG_E164(X) PG_GETARG_INT64((int64) X)
-#define PG_RETURN_E164(X) PG_RETURN_INT64((int64) X)
-
 void _PG_init(void);
 
 Datum e164_in(PG_FUNCTION_ARGS);
@@ -57,6 +53,9 @@ Datum e164_out(PG_FUNCTION_ARGS);
 Datum e164_raw(PG_FUNCTION_ARGS);
 
 Datum e164_hash(PG_FUNCTION_ARGS);
+Datum e164_hash_extended(PG_FUNCTION_ARGS);
+Datum e164_shard(PG_FUNCTION_ARGS);
+Datum e164_bloom_hash(PG_FUNCTION_ARGS);
 Datum e164_send(PG_FUNCTION_ARGS);
 Datum e164_recv(PG_FUNCTION_ARGS);
 
@@ -68,10 +67,55 @@ Datum e164_gt(PG_FUNCTION_ARGS);
 Datum e164_ne(PG_FUNCTION_ARGS);
 
 Datum e164_cmp(PG_FUNCTION_ARGS);
+Datum e164_larger(PG_FUNCTION_ARGS);
+Datum e164_smaller(PG_FUNCTION_ARGS);
+
+Datum e164_lt_int8(PG_FUNCTION_ARGS);
+Datum e164_le_int8(PG_FUNCTION_ARGS);
+Datum e164_eq_int8(PG_FUNCTION_ARGS);
+Datum e164_ge_int8(PG_FUNCTION_ARGS);
+Datum e164_gt_int8(PG_FUNCTION_ARGS);
+Datum e164_ne_int8(PG_FUNCTION_ARGS);
+Datum e164_cmp_int8(PG_FUNCTION_ARGS);
+Datum int8_lt_e164(PG_FUNCTION_ARGS);
+Datum int8_le_e164(PG_FUNCTION_ARGS);
+Datum int8_eq_e164(PG_FUNCTION_ARGS);
+Datum int8_ge_e164(PG_FUNCTION_ARGS);
+Datum int8_gt_e164(PG_FUNCTION_ARGS);
+Datum int8_ne_e164(PG_FUNCTION_ARGS);
+Datum int8_cmp_e164(PG_FUNCTION_ARGS);
+Datum e164_int8_hash(PG_FUNCTION_ARGS);
+Datum e164_int8_hash_extended(PG_FUNCTION_ARGS);
+
+Datum e164_eq_text(PG_FUNCTION_ARGS);
+Datum e164_ne_text(PG_FUNCTION_ARGS);
+Datum text_eq_e164(PG_FUNCTION_ARGS);
+Datum text_ne_e164(PG_FUNCTION_ARGS);
+Datum e164_text_hash(PG_FUNCTION_ARGS);
+Datum e164_text_hash_extended(PG_FUNCTION_ARGS);
+Datum e164_distance(PG_FUNCTION_ARGS);
+Datum e164_brin_minmax_multi_distance(PG_FUNCTION_ARGS);
+Datum e164_in_range(PG_FUNCTION_ARGS);
 
 Datum e164_cast_to_text(PG_FUNCTION_ARGS);
+Datum e164_from_digits(PG_FUNCTION_ARGS);
+Datum e164_digits(PG_FUNCTION_ARGS);
+Datum e164_from_parts(PG_FUNCTION_ARGS);
+
+Datum e164_pl_int8(PG_FUNCTION_ARGS);
+Datum int8_pl_e164(PG_FUNCTION_ARGS);
+Datum e164_mi_int8(PG_FUNCTION_ARGS);
+Datum e164_mi(PG_FUNCTION_ARGS);
+Datum e164_generate_series(PG_FUNCTION_ARGS);
 
 Datum e164_country_code(PG_FUNCTION_ARGS);
+Datum e164_country_code_int(PG_FUNCTION_ARGS);
+Datum e164_country_code_lower_bound(PG_FUNCTION_ARGS);
+Datum e164_country_code_upper_bound(PG_FUNCTION_ARGS);
+Datum e164_suffix(PG_FUNCTION_ARGS);
+
+Datum e164_lookup(PG_FUNCTION_ARGS);
+Datum e164_prefix_reload(PG_FUNCTION_ARGS);
 
 static const char * guc_area_codes_format;
 
@@ -85,6 +129,11 @@ static bool check_area_codes_format(char ** newval, void ** extra,
                                     GucSource source);
 static void assign_area_codes_format(const char * newval, void * extra);
 
+static void assign_prefix_file(const char * newval, void * extra);
+
+static bool digitsFromRawText(const text * aText, uint64 * someDigits);
+static int32 jumpConsistentHash(uint64 aKey, int32 numberOfBuckets);
+
 
 void
 _PG_init(void)
@@ -102,6 +151,26 @@ _PG_init(void)
                                assign_area_codes_format,
 #endif
                                NULL);
+
+    DefineCustomStringVariable("e164.prefix_file",
+                               gettext_noop("Sets the file to load number prefix metadata from."),
+                               gettext_noop("The file is reloaded on SIGHUP if it has changed."),
+                               &e164PrefixFile,
+                               "",
+                               PGC_SIGHUP, 0,
+                               NULL,
+                               assign_prefix_file,
+                               NULL);
+
+    DefineCustomIntVariable("e164.prefix_memory",
+                            gettext_noop("Sets the shared memory reserved for a snapshot of the number prefix metadata."),
+                            gettext_noop("Twice this amount is reserved, so that a reload does not block lookups."),
+                            &e164PrefixMemory,
+                            0, 0, MAX_KILOBYTES,
+                            PGC_POSTMASTER, GUC_UNIT_KB,
+                            NULL, NULL, NULL);
+
+    e164PrefixInit();
 }
 
 static bool
@@ -148,6 +217,34 @@ assign_area_codes_format(const char * newval, void * extra)
     e164SetAreaCodesInfo((E164AreaCodesInfo *) extra);
 }
 
+static void
+assign_prefix_file(const char * newval, void * extra)
+{
+    e164PrefixRequestReload();
+}
+
+
+/*
+ * e164StableArgument returns a varlena argument, detoasted.  If the
+ * argument is the same for every call, e.g., a constant set or filter
+ * tested against every row, it is only detoasted once per call site, and
+ * kept in fn_extra, which the caller must not otherwise use.
+ */
+struct varlena *
+e164StableArgument(FunctionCallInfo fcinfo, int argument)
+{
+    MemoryContext oldContext;
+
+    if (!get_fn_expr_arg_stable(fcinfo->flinfo, argument))
+        return PG_DETOAST_DATUM(PG_GETARG_DATUM(argument));
+    if (NULL != fcinfo->flinfo->fn_extra)
+        return (struct varlena *) fcinfo->flinfo->fn_extra;
+
+    oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    fcinfo->flinfo->fn_extra = PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(argument));
+    MemoryContextSwitchTo(oldContext);
+    return (struct varlena *) fcinfo->flinfo->fn_extra;
+}
 
 PG_FUNCTION_INFO_V1(e164_in);
 Datum
@@ -213,6 +310,157 @@ e164_cast_to_text(PG_FUNCTION_ARGS)
     PG_RETURN_TEXT_P(textString);
 }
 
+/*
+ * e164_from_digits and e164_digits cast between e164 and bigint holding
+ * the digits of a number, country code included.
+ */
+PG_FUNCTION_INFO_V1(e164_from_digits);
+Datum
+e164_from_digits(PG_FUNCTION_ARGS)
+{
+    int64 someDigits = PG_GETARG_INT64(0);
+
+    if (0 > someDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 number out of range: " INT64_FORMAT, someDigits)));
+    PG_RETURN_E164(e164FromDigits((uint64) someDigits));
+}
+
+PG_FUNCTION_INFO_V1(e164_digits);
+Datum
+e164_digits(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT64((int64) e164DigitsOf(PG_GETARG_E164(0)));
+}
+
+/*
+ * e164_from_parts(cc, nsn[, nsn_digits]) builds a number from its country
+ * code and national significant number, the latter written with
+ * nsn_digits digits if given, to keep its leading zeros.
+ */
+PG_FUNCTION_INFO_V1(e164_from_parts);
+Datum
+e164_from_parts(PG_FUNCTION_ARGS)
+{
+    int numberOfNationalDigits = 0;
+
+    if (PG_NARGS() > 2)
+        numberOfNationalDigits = PG_GETARG_INT32(2);
+    PG_RETURN_E164(e164FromParts(PG_GETARG_INT32(0), PG_GETARG_INT64(1),
+                                 numberOfNationalDigits));
+}
+
+/*
+ * Arithmetic moves along the numbers of a country code and length, e.g.,
+ * '+14155550100' + 99 is +1 415 555 0199, and never leaves them: see
+ * e164Add.
+ */
+PG_FUNCTION_INFO_V1(e164_pl_int8);
+Datum
+e164_pl_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164(e164Add(PG_GETARG_E164(0), PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(int8_pl_e164);
+Datum
+int8_pl_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164(e164Add(PG_GETARG_E164(1), PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_mi_int8);
+Datum
+e164_mi_int8(PG_FUNCTION_ARGS)
+{
+    int64 anOffset = PG_GETARG_INT64(1);
+
+    /* Out of range either way, but -PG_INT64_MIN overflows */
+    if (PG_INT64_MIN == anOffset)
+        anOffset = PG_INT64_MAX;
+    else
+        anOffset = -anOffset;
+    PG_RETURN_E164(e164Add(PG_GETARG_E164(0), anOffset));
+}
+
+PG_FUNCTION_INFO_V1(e164_mi);
+Datum
+e164_mi(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT64(e164Difference(PG_GETARG_E164(0), PG_GETARG_E164(1)));
+}
+
+/*
+ * generate_series(start, stop[, step]) returns the numbers from start to
+ * stop in steps of step, one per call.  Both bounds must be of the same
+ * country code and length, so every number in between is valid, and
+ * stepping is plain addition on E164 values.
+ */
+typedef struct E164SeriesState
+{
+    E164 current;
+    E164 stop;
+    int64 step;
+    bool done;
+} E164SeriesState;
+
+PG_FUNCTION_INFO_V1(e164_generate_series);
+Datum
+e164_generate_series(PG_FUNCTION_ARGS)
+{
+    FuncCallContext * theContext;
+    E164SeriesState * theState;
+    E164 theNumber;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        E164 theStart = PG_GETARG_E164(0);
+        E164 theStop = PG_GETARG_E164(1);
+        int64 theStep = 1;
+        MemoryContext theOldContext;
+
+        if (PG_NARGS() > 2)
+            theStep = PG_GETARG_INT64(2);
+        if (0 == theStep)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("step size cannot equal zero")));
+        if (e164CountryCodeOf(theStart) != e164CountryCodeOf(theStop) ||
+            e164NumberOfDigits(theStart) != e164NumberOfDigits(theStop))
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("E164 series bounds must have the same country code and number of digits")));
+
+        theContext = SRF_FIRSTCALL_INIT();
+        theOldContext = MemoryContextSwitchTo(theContext->multi_call_memory_ctx);
+        theState = (E164SeriesState *) palloc(sizeof(E164SeriesState));
+        MemoryContextSwitchTo(theOldContext);
+
+        theState->current = theStart;
+        theState->stop = theStop;
+        theState->step = theStep;
+        theState->done = (theStep > 0 ? theStart > theStop
+                                      : theStart < theStop);
+        theContext->user_fctx = theState;
+    }
+
+    theContext = SRF_PERCALL_SETUP();
+    theState = (E164SeriesState *) theContext->user_fctx;
+    if (theState->done)
+        SRF_RETURN_DONE(theContext);
+
+    theNumber = theState->current;
+    /* Stop before a step past stop, which could overflow */
+    if (theState->step > 0
+        ? (int64) (theState->stop - theNumber) < theState->step
+        : (int64) (theState->stop - theNumber) > theState->step)
+        theState->done = true;
+    else
+        theState->current = (E164) ((int64) theNumber + theState->step);
+    SRF_RETURN_NEXT(theContext, Int64GetDatum((int64) theNumber));
+}
+
 PG_FUNCTION_INFO_V1(e164_country_code);
 Datum
 e164_country_code(PG_FUNCTION_ARGS)
@@ -231,6 +479,71 @@ e164_country_code(PG_FUNCTION_ARGS)
     PG_RETURN_TEXT_P(textString);
 }
 
+PG_FUNCTION_INFO_V1(e164_country_code_int);
+Datum
+e164_country_code_int(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT32(countryCodeOfE164(PG_GETARG_E164(0)));
+}
+
+/*
+ * The numbers of a country code are those from its lower bound up to, not
+ * including, its upper bound, which is NULL for the last country code.
+ */
+PG_FUNCTION_INFO_V1(e164_country_code_lower_bound);
+Datum
+e164_country_code_lower_bound(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164(e164CountryCodeLowerBound(PG_GETARG_INT32(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_country_code_upper_bound);
+Datum
+e164_country_code_upper_bound(PG_FUNCTION_ARGS)
+{
+    E164 theBound;
+
+    if (!e164CountryCodeUpperBound(PG_GETARG_INT32(0), &theBound))
+        PG_RETURN_NULL();
+    PG_RETURN_E164(theBound);
+}
+
+PG_FUNCTION_INFO_V1(e164_suffix);
+Datum
+e164_suffix(PG_FUNCTION_ARGS)
+{
+    E164	aNumber = PG_GETARG_E164(0);
+    int32	numberOfDigits = PG_GETARG_INT32(1);
+    uint64	theSuffix;
+
+    if (!e164Suffix(aNumber, numberOfDigits, &theSuffix))
+        PG_RETURN_NULL();
+    PG_RETURN_INT64((int64) theSuffix);
+}
+
+PG_FUNCTION_INFO_V1(e164_lookup);
+Datum
+e164_lookup(PG_FUNCTION_ARGS)
+{
+    E164	theNumber = PG_GETARG_E164(0);
+    char *	attributeName = text_to_cstring(PG_GETARG_TEXT_PP(1));
+    char	buffer[E164PrefixAttributeMaximumLength + 1];
+
+    if (!e164PrefixLookup(theNumber,
+                          e164PrefixAttributeFromName(attributeName),
+                          buffer, sizeof(buffer)))
+        PG_RETURN_NULL();
+
+    PG_RETURN_TEXT_P(cstring_to_text(buffer));
+}
+
+PG_FUNCTION_INFO_V1(e164_prefix_reload);
+Datum
+e164_prefix_reload(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT64((int64) e164PrefixReload(true));
+}
+
 PG_FUNCTION_INFO_V1(e164_lt);
 Datum
 e164_lt(PG_FUNCTION_ARGS)
@@ -293,6 +606,82 @@ e164_cmp(PG_FUNCTION_ARGS)
     PG_RETURN_INT32(result);
 }
 
+/*
+ * e164_larger and e164_smaller are the transition and combine functions
+ * of the max and min aggregates.
+ */
+PG_FUNCTION_INFO_V1(e164_larger);
+Datum
+e164_larger(PG_FUNCTION_ARGS)
+{
+    E164 firstNumber = PG_GETARG_E164(0);
+    E164 secondNumber = PG_GETARG_E164(1);
+
+    PG_RETURN_E164((e164Comparison(firstNumber, secondNumber) >= 0) ?
+                   firstNumber : secondNumber);
+}
+
+PG_FUNCTION_INFO_V1(e164_smaller);
+Datum
+e164_smaller(PG_FUNCTION_ARGS)
+{
+    E164 firstNumber = PG_GETARG_E164(0);
+    E164 secondNumber = PG_GETARG_E164(1);
+
+    PG_RETURN_E164((e164Comparison(firstNumber, secondNumber) <= 0) ?
+                   firstNumber : secondNumber);
+}
+
+PG_FUNCTION_INFO_V1(e164_distance);
+Datum
+e164_distance(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT64((int64) e164Distance(PG_GETARG_E164(0),
+                                         PG_GETARG_E164(1)));
+}
+
+/*
+ * e164_brin_minmax_multi_distance is the distance function of the BRIN
+ * minmax-multi operator class, used to decide which ranges to merge.
+ */
+PG_FUNCTION_INFO_V1(e164_brin_minmax_multi_distance);
+Datum
+e164_brin_minmax_multi_distance(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_FLOAT8((float8) e164Distance(PG_GETARG_E164(0),
+                                           PG_GETARG_E164(1)));
+}
+
+/*
+ * e164_in_range is the btree in_range support function, for window RANGE
+ * frames such as RANGE BETWEEN 100 PRECEDING AND 100 FOLLOWING: whether
+ * value is at most (less) or at least (!less) base + offset, or base -
+ * offset if sub, in the comparison order of e164Distance.  Comparing the
+ * difference of value and base with offset never overflows, so bounds
+ * beyond the range of numbers saturate.
+ */
+PG_FUNCTION_INFO_V1(e164_in_range);
+Datum
+e164_in_range(PG_FUNCTION_ARGS)
+{
+    int64 theDifference = e164Comparison(PG_GETARG_E164(0),
+                                         PG_GETARG_E164(1));
+    int64 theOffset = PG_GETARG_INT64(2);
+    bool sub = PG_GETARG_BOOL(3);
+    bool less = PG_GETARG_BOOL(4);
+
+    if (0 > theOffset)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PRECEDING_OR_FOLLOWING_SIZE),
+                 errmsg("invalid preceding or following size in window function")));
+
+    if (sub)
+        theOffset = -theOffset;
+    if (less)
+        PG_RETURN_BOOL(theDifference <= theOffset);
+    PG_RETURN_BOOL(theDifference >= theOffset);
+}
+
 PG_FUNCTION_INFO_V1(e164_hash);
 Datum
 e164_hash(PG_FUNCTION_ARGS)
@@ -300,3 +689,321 @@ e164_hash(PG_FUNCTION_ARGS)
     E164 arg1 = PG_GETARG_E164(0);
     return hash_any((unsigned char *)&arg1, sizeof(E164));
 }
+
+/*
+ * e164_hash_extended is the 64-bit, seeded e164_hash, as used by hash
+ * partitioning; with seed 0 its low 32 bits are e164_hash.
+ */
+PG_FUNCTION_INFO_V1(e164_hash_extended);
+Datum
+e164_hash_extended(PG_FUNCTION_ARGS)
+{
+    E164 theValue = PG_GETARG_E164(0);
+    return hash_any_extended((unsigned char *) &theValue, sizeof(E164),
+                             PG_GETARG_INT64(1));
+}
+
+/*
+ * jumpConsistentHash returns the bucket of aKey among numberOfBuckets by
+ * Lamping and Veach's jump consistent hash: going from n to n + 1 buckets
+ * moves only the keys landing in the new bucket, a 1/(n + 1) share, and
+ * no state beyond the key is needed to compute it.
+ */
+static int32
+jumpConsistentHash(uint64 aKey, int32 numberOfBuckets)
+{
+    int64 theBucket = -1;
+    int64 theNextBucket = 0;
+
+    while (theNextBucket < numberOfBuckets)
+    {
+        theBucket = theNextBucket;
+        aKey = aKey * UINT64CONST(2862933555777941757) + 1;
+        theNextBucket = (int64) ((theBucket + 1) *
+                                 ((double) (INT64CONST(1) << 31) /
+                                  (double) ((aKey >> 33) + 1)));
+    }
+    return (int32) theBucket;
+}
+
+/*
+ * e164_shard(n, shards[, seed]) returns the shard, from 0 to shards - 1,
+ * of n: the jump consistent hash of e164Hash(n), which applications can
+ * compute on their own, or with a seed, of e164_hash_extended(n, seed).
+ */
+PG_FUNCTION_INFO_V1(e164_shard);
+Datum
+e164_shard(PG_FUNCTION_ARGS)
+{
+    E164 theNumber = PG_GETARG_E164(0);
+    int32 numberOfShards = PG_GETARG_INT32(1);
+    uint64 theKey;
+
+    if (numberOfShards < 1)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of shards must be at least 1")));
+
+    if (PG_NARGS() > 2)
+        theKey = DatumGetUInt64(hash_any_extended((unsigned char *) &theNumber,
+                                                  sizeof(E164),
+                                                  PG_GETARG_INT64(2)));
+    else
+        theKey = e164Hash(theNumber);
+    PG_RETURN_INT32(jumpConsistentHash(theKey, numberOfShards));
+}
+
+/*
+ * Comparisons with integers holding the digits of a number, country code
+ * included, e.g., 14155550123 for +1 415 555 0123, in the order of E164
+ * values (see e164DigitsComparison): they belong to the btree and hash
+ * operator families of e164, so that legacy int8 columns can be joined to
+ * e164 columns and probe e164 indexes without a cast per row.
+ */
+PG_FUNCTION_INFO_V1(e164_lt_int8);
+Datum
+e164_lt_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 > e164DigitsComparison(PG_GETARG_E164(0),
+                                            PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_le_int8);
+Datum
+e164_le_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 >= e164DigitsComparison(PG_GETARG_E164(0),
+                                             PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_eq_int8);
+Datum
+e164_eq_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 == e164DigitsComparison(PG_GETARG_E164(0),
+                                             PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_ge_int8);
+Datum
+e164_ge_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 <= e164DigitsComparison(PG_GETARG_E164(0),
+                                             PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_gt_int8);
+Datum
+e164_gt_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 < e164DigitsComparison(PG_GETARG_E164(0),
+                                            PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_ne_int8);
+Datum
+e164_ne_int8(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 != e164DigitsComparison(PG_GETARG_E164(0),
+                                             PG_GETARG_INT64(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_cmp_int8);
+Datum
+e164_cmp_int8(PG_FUNCTION_ARGS)
+{
+    int64 comparison = e164DigitsComparison(PG_GETARG_E164(0),
+                                            PG_GETARG_INT64(1));
+    PG_RETURN_INT32((comparison > 0) - (comparison < 0));
+}
+
+PG_FUNCTION_INFO_V1(int8_lt_e164);
+Datum
+int8_lt_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 < e164DigitsComparison(PG_GETARG_E164(1),
+                                            PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(int8_le_e164);
+Datum
+int8_le_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 <= e164DigitsComparison(PG_GETARG_E164(1),
+                                             PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(int8_eq_e164);
+Datum
+int8_eq_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 == e164DigitsComparison(PG_GETARG_E164(1),
+                                             PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(int8_ge_e164);
+Datum
+int8_ge_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 >= e164DigitsComparison(PG_GETARG_E164(1),
+                                             PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(int8_gt_e164);
+Datum
+int8_gt_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 > e164DigitsComparison(PG_GETARG_E164(1),
+                                            PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(int8_ne_e164);
+Datum
+int8_ne_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 != e164DigitsComparison(PG_GETARG_E164(1),
+                                             PG_GETARG_INT64(0)));
+}
+
+PG_FUNCTION_INFO_V1(int8_cmp_e164);
+Datum
+int8_cmp_e164(PG_FUNCTION_ARGS)
+{
+    int64 comparison = e164DigitsComparison(PG_GETARG_E164(1),
+                                            PG_GETARG_INT64(0));
+    PG_RETURN_INT32((comparison < 0) - (comparison > 0));
+}
+
+/*
+ * e164_int8_hash is the hash function of int8 in the hash operator family
+ * of e164: an integer hashes as e164_hash does the number with its
+ * digits.
+ */
+PG_FUNCTION_INFO_V1(e164_int8_hash);
+Datum
+e164_int8_hash(PG_FUNCTION_ARGS)
+{
+    E164 theValue = e164ValueOfDigits((uint64) PG_GETARG_INT64(0));
+    return hash_any((unsigned char *) &theValue, sizeof(E164));
+}
+
+PG_FUNCTION_INFO_V1(e164_int8_hash_extended);
+Datum
+e164_int8_hash_extended(PG_FUNCTION_ARGS)
+{
+    E164 theValue = e164ValueOfDigits((uint64) PG_GETARG_INT64(0));
+    return hash_any_extended((unsigned char *) &theValue, sizeof(E164),
+                             PG_GETARG_INT64(1));
+}
+
+/*
+ * digitsFromRawText returns whether aText is a number in its raw form, as
+ * output by e164_raw: a plus sign followed by at most
+ * E164MaximumNumberOfDigits digits, the first not a zero.
+ */
+static bool
+digitsFromRawText(const text * aText, uint64 * someDigits)
+{
+    const char * theString = VARDATA_ANY(aText);
+    int theLength = VARSIZE_ANY_EXHDR(aText);
+    int i;
+
+    if (theLength < 2 || theLength > E164MaximumNumberOfDigits + 1 ||
+        '+' != theString[0] || '0' == theString[1])
+        return false;
+
+    *someDigits = 0;
+    for (i = 1; i < theLength; i++)
+    {
+        if (theString[i] < '0' || theString[i] > '9')
+            return false;
+        *someDigits = *someDigits * 10 + (theString[i] - '0');
+    }
+    return true;
+}
+
+/*
+ * Equality with text holding a number in its raw form, e.g.,
+ * '+14155550123', which is independent of e164.area_codes_format.  Text in
+ * any other form equals no number.
+ */
+static inline bool
+e164EqualsText(E164 aNumber, const text * aText)
+{
+    uint64 someDigits;
+
+    return (digitsFromRawText(aText, &someDigits) &&
+            someDigits == e164DigitsOf(aNumber));
+}
+
+PG_FUNCTION_INFO_V1(e164_eq_text);
+Datum
+e164_eq_text(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(e164EqualsText(PG_GETARG_E164(0), PG_GETARG_TEXT_PP(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164_ne_text);
+Datum
+e164_ne_text(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(!e164EqualsText(PG_GETARG_E164(0), PG_GETARG_TEXT_PP(1)));
+}
+
+PG_FUNCTION_INFO_V1(text_eq_e164);
+Datum
+text_eq_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(e164EqualsText(PG_GETARG_E164(1), PG_GETARG_TEXT_PP(0)));
+}
+
+PG_FUNCTION_INFO_V1(text_ne_e164);
+Datum
+text_ne_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(!e164EqualsText(PG_GETARG_E164(1), PG_GETARG_TEXT_PP(0)));
+}
+
+/*
+ * e164_text_hash is the hash function of text in the hash operator family
+ * of e164: text in raw form hashes as e164_hash does the number.
+ */
+PG_FUNCTION_INFO_V1(e164_text_hash);
+Datum
+e164_text_hash(PG_FUNCTION_ARGS)
+{
+    text * aText = PG_GETARG_TEXT_PP(0);
+    uint64 someDigits;
+    E164 theValue;
+
+    if (!digitsFromRawText(aText, &someDigits))
+        return hash_any((unsigned char *) VARDATA_ANY(aText),
+                        VARSIZE_ANY_EXHDR(aText));
+    theValue = e164ValueOfDigits(someDigits);
+    return hash_any((unsigned char *) &theValue, sizeof(E164));
+}
+
+PG_FUNCTION_INFO_V1(e164_text_hash_extended);
+Datum
+e164_text_hash_extended(PG_FUNCTION_ARGS)
+{
+    text * aText = PG_GETARG_TEXT_PP(0);
+    uint64 someDigits;
+    E164 theValue;
+
+    if (!digitsFromRawText(aText, &someDigits))
+        return hash_any_extended((unsigned char *) VARDATA_ANY(aText),
+                                 VARSIZE_ANY_EXHDR(aText),
+                                 PG_GETARG_INT64(1));
+    theValue = e164ValueOfDigits(someDigits);
+    return hash_any_extended((unsigned char *) &theValue, sizeof(E164),
+                             PG_GETARG_INT64(1));
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_hash);
+Datum
+e164_bloom_hash(PG_FUNCTION_ARGS)
+{
+    uint64 hash = e164Hash(PG_GETARG_E164(0));
+    PG_RETURN_INT32((int32) (hash ^ (hash >> 32)));
+}
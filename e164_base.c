@@ -58,6 +58,25 @@
 
 #define E164_MAX_NUMBER_VALUE     UINT64CONST(999999999999999)
 
+static const uint64 powersOfTen[E164MaximumNumberOfDigits + 1] = {
+    UINT64CONST(1),
+    UINT64CONST(10),
+    UINT64CONST(100),
+    UINT64CONST(1000),
+    UINT64CONST(10000),
+    UINT64CONST(100000),
+    UINT64CONST(1000000),
+    UINT64CONST(10000000),
+    UINT64CONST(100000000),
+    UINT64CONST(1000000000),
+    UINT64CONST(10000000000),
+    UINT64CONST(100000000000),
+    UINT64CONST(1000000000000),
+    UINT64CONST(10000000000000),
+    UINT64CONST(100000000000000),
+    UINT64CONST(1000000000000000)
+};
+
 
 /*
  * Function prototypes
@@ -78,6 +97,13 @@ static inline int stringFromE164_no_check (char * aString, int stringLength,
 
 static inline void checkE164CountryCodeForRangeError (E164CountryCode theCountryCode);
 static inline int countryCodeLengthOf (E164CountryCode countryCode);
+static inline int numberOfDigitsOf (uint64 aNumber);
+static inline int minimumSubscriberNumberLengthOf (E164Type aType);
+static E164Type assignedE164TypeForCountryCode (E164CountryCode aCountryCode);
+static inline E164Type countryCodeOfDigits (uint64 someDigits,
+                                            int totalNumberOfDigits,
+                                            E164CountryCode * aCountryCode,
+                                            int * numberOfCountryCodeDigits);
 
 
 /*
@@ -126,6 +152,154 @@ int64 e164Comparison (E164 firstNumber, E164 secondNumber)
             (int64)(secondNumber & E164_COMPARISON_MASK));
 }
 
+/*
+ * e164Distance returns the absolute difference of two numbers in the
+ * comparison order.  Within a country code this is the numeric distance
+ * between the numbers; as the cached country code occupies the high bits,
+ * numbers of different country codes are always much farther apart.
+ */
+uint64 e164Distance (E164 firstNumber, E164 secondNumber)
+{
+    int64 comparison = e164Comparison(firstNumber, secondNumber);
+    return (comparison < 0) ? (uint64) -comparison : (uint64) comparison;
+}
+
+/*
+ * e164Successor returns the number immediately following aNumber in the
+ * comparison order within its country code: the next number of the same
+ * length or, once the subscriber number is all nines, the lowest number
+ * one digit longer.  E.g., +1 999 is followed by +1 0000.
+ */
+E164 e164Successor (E164 aNumber)
+{
+    E164CountryCode theCountryCode = e164CountryCodeOf(aNumber);
+    uint64 theNumber = aNumber & E164_NUMBER_MASK;
+    int totalNumberOfDigits = numberOfDigitsOf(theNumber);
+    int subscriberNumberLength = (totalNumberOfDigits -
+                                  countryCodeLengthOf(theCountryCode));
+    uint64 subscriberNumber = (theNumber - theCountryCode *
+                               powersOfTen[subscriberNumberLength]);
+
+    if (subscriberNumber + 1 < powersOfTen[subscriberNumberLength])
+        theNumber += 1;
+    else if (totalNumberOfDigits < E164MaximumNumberOfDigits)
+        theNumber = theCountryCode * powersOfTen[subscriberNumberLength + 1];
+    else
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 number out of range"),
+                 errdetail("+" UINT64_FORMAT " is the last number of country code %d.",
+                           theNumber, theCountryCode)));
+
+    return (theNumber | (aNumber & E164_CACHED_CC_MASK));
+}
+
+/*
+ * e164Add returns the number anOffset after aNumber in the comparison
+ * order, e.g., +1 415 555 0199 for +1 415 555 0100 and 99, or before it if
+ * anOffset is negative.  The result must be a valid number of the same
+ * country code and length: digits may be added in front of a national
+ * number without leaving its country code, e.g., +1 04 155 550 100 for
+ * +1 415 555 0100 and 90000000000, but that is no longer counting along
+ * the numbers of a block.
+ */
+E164 e164Add (E164 aNumber, int64 anOffset)
+{
+    E164CountryCode theCountryCode = e164CountryCodeOf(aNumber);
+    int64 theDigits = (int64) (aNumber & E164_NUMBER_MASK);
+    int64 theResult = 0;
+    E164CountryCode theResultCountryCode = 0;
+    int numberOfDigits = numberOfDigitsOf((uint64) theDigits);
+    int numberOfCountryCodeDigits;
+
+    if (anOffset >= -(int64) E164_MAX_NUMBER_VALUE &&
+        anOffset <= (int64) E164_MAX_NUMBER_VALUE)
+        theResult = theDigits + anOffset;
+    if (theResult <= 0 || (uint64) theResult > E164_MAX_NUMBER_VALUE ||
+        numberOfDigitsOf((uint64) theResult) != numberOfDigits ||
+        isInvalidE164Type(countryCodeOfDigits((uint64) theResult,
+                                              numberOfDigits,
+                                              &theResultCountryCode,
+                                              &numberOfCountryCodeDigits)) ||
+        theResultCountryCode != theCountryCode)
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 number out of range"),
+                 errdetail("Adding " INT64_FORMAT " to +" INT64_FORMAT " leaves the %d-digit numbers of country code %d.",
+                           anOffset, theDigits, numberOfDigits,
+                           theCountryCode)));
+
+    return e164FromDigits((uint64) theResult);
+}
+
+/*
+ * e164Difference returns the number of numbers from secondNumber to
+ * firstNumber in the comparison order, which must be of the same country
+ * code and length: the inverse of e164Add.
+ */
+int64 e164Difference (E164 firstNumber, E164 secondNumber)
+{
+    E164CountryCode theCountryCode = e164CountryCodeOf(firstNumber);
+
+    if (theCountryCode != e164CountryCodeOf(secondNumber))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("cannot subtract E164 numbers of different country codes"),
+                 errdetail("The country codes are %d and %d.", theCountryCode,
+                           e164CountryCodeOf(secondNumber))));
+    if (e164NumberOfDigits(firstNumber) != e164NumberOfDigits(secondNumber))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("cannot subtract E164 numbers of different lengths"),
+                 errdetail("The numbers have %d and %d digits.",
+                           e164NumberOfDigits(firstNumber),
+                           e164NumberOfDigits(secondNumber))));
+
+    return ((int64) (firstNumber & E164_NUMBER_MASK) -
+            (int64) (secondNumber & E164_NUMBER_MASK));
+}
+
+/*
+ * e164Hash returns a 64-bit hash of aNumber: the MurmurHash3 finalizer
+ * applied to the comparison bits.  This is much cheaper than hash_any over
+ * the bytes of the number, and mixes well enough for bloom filters and
+ * sketches, which need more than the 32 bits of e164_hash.
+ */
+uint64 e164Hash (E164 aNumber)
+{
+    uint64 theHash = aNumber & E164_COMPARISON_MASK;
+
+    theHash ^= theHash >> 33;
+    theHash *= UINT64CONST(0xff51afd7ed558ccd);
+    theHash ^= theHash >> 33;
+    theHash *= UINT64CONST(0xc4ceb9fe1a85ec53);
+    theHash ^= theHash >> 33;
+    return theHash;
+}
+
+/*
+ * e164Suffix assigns to aSuffix the last numberOfDigits digits of aNumber
+ * as an integer, e.g., 5550123 for the last seven digits of +1 415 555
+ * 0123, as used to match caller IDs which lack the country code and often
+ * part of the national number.  Returns false if aNumber has fewer than
+ * numberOfDigits digits, as it then has no such suffix: its digits with
+ * leading zeros would otherwise match.
+ */
+bool e164Suffix (E164 aNumber, int numberOfDigits, uint64 * aSuffix)
+{
+    if (numberOfDigits < 1 || numberOfDigits > E164MaximumNumberOfDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid number of suffix digits: %d", numberOfDigits),
+                 errdetail("The number of suffix digits must be between 1 and %d.",
+                           E164MaximumNumberOfDigits)));
+    e164SanityCheck(aNumber);
+    if (e164NumberOfDigits(aNumber) < numberOfDigits)
+        return false;
+    *aSuffix = (aNumber & E164_NUMBER_MASK) % powersOfTen[numberOfDigits];
+    return true;
+}
+
 static inline
 E164CountryCode e164CountryCodeOf (E164 theNumber)
 {
@@ -151,6 +325,24 @@ int countryCodeStringFromE164 (char * aString, int stringLength, E164 aNumber)
                     "%d", e164CountryCodeOf(aNumber));
 }
 
+/*
+ * countryCodeOfE164 returns the country code of aNumber, e.g., 44 for
+ * +44 20 7377 9923.
+ */
+E164CountryCode countryCodeOfE164 (E164 aNumber)
+{
+    return e164CountryCodeOf(aNumber);
+}
+
+/*
+ * e164NumberOfDigits returns the number of digits of aNumber, country code
+ * included, e.g., 11 for +1 415 555 0123.
+ */
+int e164NumberOfDigits (E164 aNumber)
+{
+    return numberOfDigitsOf(aNumber & E164_NUMBER_MASK);
+}
+
 /*
  * stringFromE164 assigns the string representation of aNumber to aString
  */
@@ -173,6 +365,29 @@ int rawStringFromE164_no_check (char * aString, int stringLength, E164 aNumber)
                     "+" UINT64_FORMAT, (aNumber & E164_NUMBER_MASK));
 }
 
+/*
+ * digitsFromE164 assigns the digits of aNumber to digits as values 0-9
+ * (not characters), returning the number of digits.  The digits array
+ * must have room for E164MaximumNumberOfDigits values.  Unlike the string
+ * functions above, this works on the number field directly.
+ */
+int digitsFromE164 (uint8 * digits, E164 aNumber)
+{
+    uint64 theNumber;
+    int numberOfDigits;
+    int i;
+
+    e164SanityCheck(aNumber);
+    theNumber = aNumber & E164_NUMBER_MASK;
+    numberOfDigits = numberOfDigitsOf(theNumber);
+    for (i = numberOfDigits - 1; i >= 0; --i)
+    {
+        digits[i] = theNumber % 10;
+        theNumber /= 10;
+    }
+    return numberOfDigits;
+}
+
 /*
  * Insert spaces into the rest of the phone number digits, to
  * group them in packs of 4 from the tail, wherever possible,
@@ -431,41 +646,300 @@ bad_format:
 }
 
 /*
- * hasValidLengthForE164Type returns true if the number of digits in
- * the number is consistent with its E164Type and E164CountryCode
+ * countryCodeOfDigits finds the country code of a number given as its
+ * digits, as e164FromString does: the shortest prefix which is not an
+ * invalid country code.  It returns the type of the country code, which
+ * is invalid if there is none.
  */
 static inline
-bool hasValidLengthForE164Type (int numberLength,
-                                int countryCodeLength,
-                                E164Type aType)
+E164Type countryCodeOfDigits (uint64 someDigits, int totalNumberOfDigits,
+                              E164CountryCode * aCountryCode,
+                              int * numberOfCountryCodeDigits)
 {
-    int subscriberNumberLength = (numberLength - countryCodeLength);
-    if (0 > subscriberNumberLength)
-        elog(ERROR, "numberLength and countryCodeLength values are invalid: %d vs. %d", numberLength, countryCodeLength);
+    E164Type theType = E164Invalid;
 
-    if (0 == subscriberNumberLength)
-        return false;
+    for (*numberOfCountryCodeDigits = 1;
+         *numberOfCountryCodeDigits <= E164MaximumCountryCodeLength &&
+             *numberOfCountryCodeDigits <= totalNumberOfDigits;
+         (*numberOfCountryCodeDigits)++)
+    {
+        *aCountryCode = (someDigits /
+                         powersOfTen[totalNumberOfDigits -
+                                     *numberOfCountryCodeDigits]);
+        theType = e164TypeForCountryCode(*aCountryCode);
+        if (!isInvalidE164Type(theType))
+            break;
+    }
+    return theType;
+}
 
+/*
+ * e164FromDigits returns the E164 value whose digits, country code
+ * included, are those of someDigits, e.g., 14155550123 for
+ * +1 415 555 0123.  The country code is recovered the same way as in
+ * e164FromString, and the same checks apply.
+ */
+E164 e164FromDigits (uint64 someDigits)
+{
+    E164CountryCode theCountryCode = 0;
+    E164Type theType;
+    int totalNumberOfDigits;
+    int numberOfCountryCodeDigits;
+
+    if (0 == someDigits || E164_MAX_NUMBER_VALUE < someDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 number out of range: " UINT64_FORMAT,
+                        someDigits),
+                 errhint("E164 values must have between %d and %d digits.",
+                         E164MinimumNumberOfDigits,
+                         E164MaximumNumberOfDigits)));
+
+    totalNumberOfDigits = numberOfDigitsOf(someDigits);
+    theType = countryCodeOfDigits(someDigits, totalNumberOfDigits,
+                                  &theCountryCode,
+                                  &numberOfCountryCodeDigits);
+
+    if (isInvalidE164Type(theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid E164 country code for E164 number \"+" UINT64_FORMAT "\": %d",
+                        someDigits, theCountryCode)));
+
+    if (isUnassignedE164Type(theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("unassigned country code for E164 number \"+" UINT64_FORMAT "\": %d",
+                        someDigits, theCountryCode)));
+
+    if (totalNumberOfDigits <= numberOfCountryCodeDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("no subscriber number digits in E164 number \"+" UINT64_FORMAT "\"",
+                        someDigits)));
+
+    if (!hasValidLengthForE164Type(totalNumberOfDigits,
+                                   numberOfCountryCodeDigits,
+                                   theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("inconsistent length and country code for E164 number \"+" UINT64_FORMAT "\" (country code: %d)",
+                        someDigits, theCountryCode)));
+
+    return (someDigits | (((uint64) theCountryCode) << E164_CC_MASK_OFFSET));
+}
+
+/*
+ * e164FromParts returns the E164 value with country code aCountryCode and
+ * national significant number nationalNumber, written with
+ * numberOfNationalDigits digits, leading zeros included, or as it is if
+ * numberOfNationalDigits is 0.  It checks the country code as E164 input
+ * does, and the number as e164FromDigits does, without a text round trip.
+ */
+E164 e164FromParts (E164CountryCode aCountryCode, int64 nationalNumber,
+                    int numberOfNationalDigits)
+{
+    int minimumNumberOfNationalDigits;
+
+    (void) assignedE164TypeForCountryCode(aCountryCode);
+
+    if (0 > nationalNumber)
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("national significant number out of range: " INT64_FORMAT,
+                        nationalNumber)));
+    if (0 > numberOfNationalDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid number of national significant number digits: %d",
+                        numberOfNationalDigits)));
+
+    minimumNumberOfNationalDigits = numberOfDigitsOf(nationalNumber);
+    if (0 == numberOfNationalDigits)
+        numberOfNationalDigits = minimumNumberOfNationalDigits;
+    else if (numberOfNationalDigits < minimumNumberOfNationalDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("national significant number " INT64_FORMAT " has more than %d digits",
+                        nationalNumber, numberOfNationalDigits)));
+
+    if (countryCodeLengthOf(aCountryCode) + numberOfNationalDigits >
+        E164MaximumNumberOfDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 number out of range: +%d " INT64_FORMAT,
+                        aCountryCode, nationalNumber),
+                 errhint("E164 values must have between %d and %d digits.",
+                         E164MinimumNumberOfDigits,
+                         E164MaximumNumberOfDigits)));
+
+    return e164FromDigits(aCountryCode * powersOfTen[numberOfNationalDigits] +
+                          (uint64) nationalNumber);
+}
+
+/*
+ * assignedE164TypeForCountryCode returns the E164Type of aCountryCode,
+ * after checking it is an assigned country code as E164 input does.
+ */
+static E164Type
+assignedE164TypeForCountryCode (E164CountryCode aCountryCode)
+{
+    E164Type theType;
+
+    if (!e164CountryCodeIsInRange(aCountryCode))
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 country code out of range: %d", aCountryCode)));
+    theType = e164TypeForCountryCode(aCountryCode);
+    if (isInvalidE164Type(theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid E164 country code: %d", aCountryCode)));
+    if (isUnassignedE164Type(theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("unassigned E164 country code: %d", aCountryCode)));
+    return theType;
+}
+
+/*
+ * e164CountryCodeLowerBound returns the lowest number of aCountryCode in
+ * the comparison order: the country code followed by as few zeros as its
+ * type allows, e.g., +44 0.  As the country code occupies the high bits
+ * of a number, the numbers of a country code are those from its lower
+ * bound up to, not including, that of the next assigned country code.
+ */
+E164 e164CountryCodeLowerBound (E164CountryCode aCountryCode)
+{
+    E164Type theType = assignedE164TypeForCountryCode(aCountryCode);
+
+    return e164FromParts(aCountryCode, 0,
+                         minimumSubscriberNumberLengthOf(theType));
+}
+
+/*
+ * e164CountryCodeUpperBound assigns to aBound the lowest number above
+ * those of aCountryCode: the lower bound of the next assigned country
+ * code.  Returns false if there is none, as for the last one.
+ */
+bool e164CountryCodeUpperBound (E164CountryCode aCountryCode, E164 * aBound)
+{
+    E164CountryCode theCountryCode;
+
+    (void) assignedE164TypeForCountryCode(aCountryCode);
+    for (theCountryCode = aCountryCode + 1;
+         theCountryCode <= E164_MAX_COUNTRY_CODE_VALUE;
+         theCountryCode++)
+    {
+        E164Type theType = e164TypeForCountryCode(theCountryCode);
+
+        if (isValidE164Type(theType) && !isUnassignedE164Type(theType))
+        {
+            *aBound = e164CountryCodeLowerBound(theCountryCode);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * e164DigitsOf returns the digits of aNumber, country code included, as
+ * an integer: the inverse of e164FromDigits.
+ */
+uint64 e164DigitsOf (E164 aNumber)
+{
+    e164SanityCheck(aNumber);
+    return (aNumber & E164_NUMBER_MASK);
+}
+
+/*
+ * e164ValueOfDigits returns the value an E164 number with someDigits,
+ * country code included, has or would have: someDigits with the country
+ * code recovered as in e164FromDigits cached, or with none if there is no
+ * valid country code.  Unlike e164FromDigits it never fails, and is meant
+ * for comparing and hashing integers consistently with E164 values;
+ * someDigits out of range are returned as they are.
+ */
+E164 e164ValueOfDigits (uint64 someDigits)
+{
+    E164CountryCode theCountryCode = 0;
+    int numberOfCountryCodeDigits;
+
+    if (0 == someDigits || E164_MAX_NUMBER_VALUE < someDigits)
+        return someDigits;
+    if (isInvalidE164Type(countryCodeOfDigits(someDigits,
+                                              numberOfDigitsOf(someDigits),
+                                              &theCountryCode,
+                                              &numberOfCountryCodeDigits)))
+        theCountryCode = 0;
+    return (someDigits | (((uint64) theCountryCode) << E164_CC_MASK_OFFSET));
+}
+
+/*
+ * e164DigitsComparison compares aNumber with an integer holding the
+ * digits of a number, country code included, in the order of
+ * e164Comparison.  The integer need not be a valid number: it sorts as
+ * e164ValueOfDigits, and integers out of range sort before or after every
+ * number, so that integers and E164 values are totally ordered together.
+ */
+int64 e164DigitsComparison (E164 aNumber, int64 someDigits)
+{
+    e164SanityCheck(aNumber);
+
+    if (someDigits <= 0)
+        return 1;
+    if ((uint64) someDigits > E164_MAX_NUMBER_VALUE)
+        return -1;
+    return ((int64)(aNumber & E164_COMPARISON_MASK) -
+            (int64) e164ValueOfDigits(someDigits));
+}
+
+/*
+ * minimumSubscriberNumberLengthOf returns the fewest digits a number of
+ * aType has after its country code.
+ */
+static inline
+int minimumSubscriberNumberLengthOf (E164Type aType)
+{
     switch (aType)
     {
         case E164GeographicArea:
-            return (E164GeographicAreaMinimumSubscriberNumberLength <= subscriberNumberLength);
+            return E164GeographicAreaMinimumSubscriberNumberLength;
 
         case E164GlobalService:
-            return (E164GlobalServiceMinimumSubscriberNumberLength <= subscriberNumberLength);
+            return E164GlobalServiceMinimumSubscriberNumberLength;
 
         case E164Network:
-            return (E164NetworkMinimumSubscriberNumberLength <= subscriberNumberLength);
+            return E164NetworkMinimumSubscriberNumberLength;
 
         case E164GroupOfCountries:
-            return (E164GroupOfCountriesMinimumSubscriberNumberLength <= subscriberNumberLength);
+            return E164GroupOfCountriesMinimumSubscriberNumberLength;
 
         default:
             ; /* fall through to elog() */
     }
 
     elog(ERROR, "E164Type value is invalid: %d", aType);
-    return false; /* keep compiler quiet */
+    return 0; /* keep compiler quiet */
+}
+
+/*
+ * hasValidLengthForE164Type returns true if the number of digits in
+ * the number is consistent with its E164Type and E164CountryCode
+ */
+static inline
+bool hasValidLengthForE164Type (int numberLength,
+                                int countryCodeLength,
+                                E164Type aType)
+{
+    int subscriberNumberLength = (numberLength - countryCodeLength);
+    if (0 > subscriberNumberLength)
+        elog(ERROR, "numberLength and countryCodeLength values are invalid: %d vs. %d", numberLength, countryCodeLength);
+
+    if (0 == subscriberNumberLength)
+        return false;
+
+    return (minimumSubscriberNumberLengthOf(aType) <= subscriberNumberLength);
 }
 
 /*
@@ -496,6 +970,20 @@ int countryCodeLengthOf (E164CountryCode countryCode)
     return (countryCode < 10) ? 1 : ((countryCode < 100) ? 2 : 3);
 }
 
+/*
+ * numberOfDigitsOf returns the number of decimal digits of aNumber, which
+ * must not exceed E164_MAX_NUMBER_VALUE.
+ */
+static inline
+int numberOfDigitsOf (uint64 aNumber)
+{
+    int digits = 1;
+    while (digits < E164MaximumNumberOfDigits &&
+           aNumber >= powersOfTen[digits])
+        ++digits;
+    return digits;
+}
+
 /*
  * isUnassignedE164Type returns true if aType is unassigned or false otherwise.
  */
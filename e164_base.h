@@ -33,6 +33,7 @@
 #define E164_BASE_H
 
 #include "postgres.h"
+#include "fmgr.h"
 
 #if PG_VERSION_NUM < 90100
 #define GUC_check_errdetail(args...)                    \
@@ -88,6 +89,19 @@ typedef enum E164StructureLimit
 typedef int4 E164CountryCode;
 typedef uint64 E164;
 
+/*
+ * PostgreSQL Interface macros
+ */
+#define DatumGetE164P(X) DatumGetInt64(X)
+#define E164PGetDatum(X) Int64GetDatum(X)
+
+#define PG_GETARG_E164(X) PG_GETARG_INT64((int64) X)
+#define PG_RETURN_E164(X) PG_RETURN_INT64((int64) X)
+
+/* In e164.c */
+extern struct varlena * e164StableArgument(FunctionCallInfo fcinfo,
+                                           int argument);
+
 /*
  * There are four types of assigned E164:
  *    * Geographic Area numbers
@@ -147,8 +161,26 @@ extern int stringFromE164 (char * aString, int stringLength, E164 aNumber);
 extern int rawStringFromE164 (char * aString, int stringLength, E164 aNumber);
 extern int countryCodeStringFromE164 (char * aString, int stringLength,
                                       E164 aNumber);
+extern int digitsFromE164 (uint8 * digits, E164 aNumber);
+extern E164CountryCode countryCodeOfE164 (E164 aNumber);
+extern int e164NumberOfDigits (E164 aNumber);
 
 extern int64 e164Comparison (E164 firstNumber, E164 secondNumber);
+extern uint64 e164Distance (E164 firstNumber, E164 secondNumber);
+extern E164 e164Successor (E164 aNumber);
+extern E164 e164Add (E164 aNumber, int64 anOffset);
+extern int64 e164Difference (E164 firstNumber, E164 secondNumber);
+extern bool e164Suffix (E164 aNumber, int numberOfDigits, uint64 * aSuffix);
+extern uint64 e164Hash (E164 aNumber);
+extern E164 e164FromDigits (uint64 someDigits);
+extern E164 e164FromParts (E164CountryCode aCountryCode, int64 nationalNumber,
+                           int numberOfNationalDigits);
+extern E164 e164CountryCodeLowerBound (E164CountryCode aCountryCode);
+extern bool e164CountryCodeUpperBound (E164CountryCode aCountryCode,
+                                      E164 * aBound);
+extern uint64 e164DigitsOf (E164 aNumber);
+extern E164 e164ValueOfDigits (uint64 someDigits);
+extern int64 e164DigitsComparison (E164 aNumber, int64 someDigits);
 
 extern bool stringHasValidE164Prefix (const char * aString);
 extern bool e164CountryCodeIsInRange (E164CountryCode theCountryCode);
@@ -0,0 +1,334 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Contiguous block aggregates
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
+#include "e164_base.h"
+
+/*
+ * e164_blocks_agg(n) summarizes a set of numbers as the blocks of
+ * consecutive numbers it contains, within each country code, in the
+ * integer order of e164Comparison: +1 415 555 0100 through +1 415 555 0199
+ * is a block of 100 numbers.
+ *
+ * The state is a list of runs, extended in place while the input arrives
+ * in order, so that sorted input (e.g., from an index scan) takes memory
+ * proportional to the number of blocks.  Whenever the list fills up it is
+ * sorted and overlapping and adjacent runs are merged; duplicates are
+ * absorbed, so the count of a block is the number of distinct numbers in
+ * it.
+ */
+#define E164BlocksInitialCapacity  64
+
+typedef struct E164Block
+{
+    E164 first;
+    E164 last;
+} E164Block;
+
+typedef struct E164Blocks
+{
+    int32 numberOfBlocks;
+    int32 capacity;
+    E164Block * blocks;
+} E164Blocks;
+
+/*
+ * The serialized form of the aggregate state, only ever read back by the
+ * same server.
+ */
+typedef struct E164BlocksSummary
+{
+    int32 vl_len_;
+    int32 numberOfBlocks;
+    E164Block blocks[FLEXIBLE_ARRAY_MEMBER];
+} E164BlocksSummary;
+
+#define E164BlocksSummarySize(numberOfBlocks) \
+    (offsetof(E164BlocksSummary, blocks) \
+     + (Size) (numberOfBlocks) * sizeof(E164Block))
+
+Datum e164_blocks_agg_transfn(PG_FUNCTION_ARGS);
+Datum e164_blocks_agg_finalfn(PG_FUNCTION_ARGS);
+Datum e164_blocks_agg_combinefn(PG_FUNCTION_ARGS);
+Datum e164_blocks_agg_serialfn(PG_FUNCTION_ARGS);
+Datum e164_blocks_agg_deserialfn(PG_FUNCTION_ARGS);
+
+static E164Blocks * newBlocks(MemoryContext aContext, int32 capacity);
+static void blocksAppend(MemoryContext aContext, E164Blocks * someBlocks,
+                         E164 first, E164 last);
+static void blocksAdd(MemoryContext aContext, E164Blocks * someBlocks,
+                      E164 aNumber);
+static void blocksCompact(E164Blocks * someBlocks);
+static int  compareBlocks(const void * a, const void * b);
+
+
+static E164Blocks *
+newBlocks(MemoryContext aContext, int32 capacity)
+{
+    E164Blocks * theBlocks = MemoryContextAlloc(aContext, sizeof(E164Blocks));
+
+    theBlocks->numberOfBlocks = 0;
+    theBlocks->capacity = Max(capacity, E164BlocksInitialCapacity);
+    theBlocks->blocks = MemoryContextAlloc(aContext,
+                                           theBlocks->capacity * sizeof(E164Block));
+    return theBlocks;
+}
+
+/*
+ * blocksAppend appends a run, first compacting the list when it is full
+ * and growing it when compacting leaves it more than half full.
+ */
+static void
+blocksAppend(MemoryContext aContext, E164Blocks * someBlocks,
+             E164 first, E164 last)
+{
+    if (someBlocks->numberOfBlocks == someBlocks->capacity)
+    {
+        blocksCompact(someBlocks);
+        if (someBlocks->numberOfBlocks > someBlocks->capacity / 2)
+        {
+            E164Block * theBlocks =
+                MemoryContextAlloc(aContext,
+                                   2 * someBlocks->capacity * sizeof(E164Block));
+
+            memcpy(theBlocks, someBlocks->blocks,
+                   someBlocks->numberOfBlocks * sizeof(E164Block));
+            pfree(someBlocks->blocks);
+            someBlocks->blocks = theBlocks;
+            someBlocks->capacity *= 2;
+        }
+    }
+    someBlocks->blocks[someBlocks->numberOfBlocks].first = first;
+    someBlocks->blocks[someBlocks->numberOfBlocks].last = last;
+    someBlocks->numberOfBlocks++;
+}
+
+static void
+blocksAdd(MemoryContext aContext, E164Blocks * someBlocks, E164 aNumber)
+{
+    if (someBlocks->numberOfBlocks > 0)
+    {
+        E164Block * theLastBlock =
+            &someBlocks->blocks[someBlocks->numberOfBlocks - 1];
+        int64 theComparison = e164Comparison(aNumber, theLastBlock->last);
+
+        if (1 == theComparison)
+        {
+            theLastBlock->last = aNumber;
+            return;
+        }
+        if (theComparison <= 0 &&
+            e164Comparison(aNumber, theLastBlock->first) >= 0)
+            return;
+    }
+    blocksAppend(aContext, someBlocks, aNumber, aNumber);
+}
+
+/*
+ * blocksCompact sorts the runs and merges those which overlap or adjoin.
+ */
+static void
+blocksCompact(E164Blocks * someBlocks)
+{
+    int32 numberOfBlocks = 0;
+    int32 i;
+
+    if (someBlocks->numberOfBlocks < 2)
+        return;
+
+    qsort(someBlocks->blocks, someBlocks->numberOfBlocks, sizeof(E164Block),
+          compareBlocks);
+    for (i = 1; i < someBlocks->numberOfBlocks; i++)
+    {
+        E164Block * theBlock = &someBlocks->blocks[numberOfBlocks];
+        E164Block * theNextBlock = &someBlocks->blocks[i];
+
+        if (e164Comparison(theNextBlock->first, theBlock->last) <= 1)
+        {
+            if (e164Comparison(theNextBlock->last, theBlock->last) > 0)
+                theBlock->last = theNextBlock->last;
+        }
+        else
+            someBlocks->blocks[++numberOfBlocks] = *theNextBlock;
+    }
+    someBlocks->numberOfBlocks = numberOfBlocks + 1;
+}
+
+static int
+compareBlocks(const void * a, const void * b)
+{
+    int64 theComparison = e164Comparison(((const E164Block *) a)->first,
+                                         ((const E164Block *) b)->first);
+
+    return (theComparison > 0) - (theComparison < 0);
+}
+
+PG_FUNCTION_INFO_V1(e164_blocks_agg_transfn);
+Datum
+e164_blocks_agg_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164Blocks * theBlocks;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_blocks_agg_transfn called in non-aggregate context");
+
+    if (PG_ARGISNULL(0))
+        theBlocks = newBlocks(aggContext, E164BlocksInitialCapacity);
+    else
+        theBlocks = (E164Blocks *) PG_GETARG_POINTER(0);
+
+    if (!PG_ARGISNULL(1))
+        blocksAdd(aggContext, theBlocks, PG_GETARG_E164(1));
+    PG_RETURN_POINTER(theBlocks);
+}
+
+/*
+ * e164_blocks_agg_finalfn returns the blocks as an array of e164_block
+ * (first, last, count), in order.
+ */
+PG_FUNCTION_INFO_V1(e164_blocks_agg_finalfn);
+Datum
+e164_blocks_agg_finalfn(PG_FUNCTION_ARGS)
+{
+    E164Blocks * theBlocks;
+    Oid theEntryType;
+    TupleDesc theDescriptor;
+    int16 theEntryLength;
+    bool theEntryByValue;
+    char theEntryAlignment;
+    Datum * theEntries;
+    int32 i;
+
+    if (PG_ARGISNULL(0))
+        PG_RETURN_NULL();
+    theBlocks = (E164Blocks *) PG_GETARG_POINTER(0);
+    blocksCompact(theBlocks);
+
+    theEntryType = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+    if (!OidIsValid(theEntryType))
+        elog(ERROR, "could not determine the e164_block type");
+    theDescriptor = lookup_rowtype_tupdesc(theEntryType, -1);
+    get_typlenbyvalalign(theEntryType, &theEntryLength, &theEntryByValue,
+                         &theEntryAlignment);
+
+    theEntries = palloc(theBlocks->numberOfBlocks * sizeof(Datum));
+    for (i = 0; i < theBlocks->numberOfBlocks; i++)
+    {
+        E164Block * theBlock = &theBlocks->blocks[i];
+        Datum values[3];
+        bool nulls[3] = {false, false, false};
+
+        values[0] = E164PGetDatum(theBlock->first);
+        values[1] = E164PGetDatum(theBlock->last);
+        values[2] = Int64GetDatum(e164Distance(theBlock->first,
+                                               theBlock->last) + 1);
+        theEntries[i] = HeapTupleGetDatum(heap_form_tuple(theDescriptor,
+                                                          values, nulls));
+    }
+    ReleaseTupleDesc(theDescriptor);
+
+    PG_RETURN_ARRAYTYPE_P(construct_array(theEntries, theBlocks->numberOfBlocks,
+                                          theEntryType, theEntryLength,
+                                          theEntryByValue, theEntryAlignment));
+}
+
+PG_FUNCTION_INFO_V1(e164_blocks_agg_combinefn);
+Datum
+e164_blocks_agg_combinefn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164Blocks * theBlocks;
+    E164Blocks * theOtherBlocks;
+    int32 i;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_blocks_agg_combinefn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    theOtherBlocks = (E164Blocks *) PG_GETARG_POINTER(1);
+    if (PG_ARGISNULL(0))
+        theBlocks = newBlocks(aggContext, theOtherBlocks->numberOfBlocks);
+    else
+        theBlocks = (E164Blocks *) PG_GETARG_POINTER(0);
+
+    for (i = 0; i < theOtherBlocks->numberOfBlocks; i++)
+        blocksAppend(aggContext, theBlocks, theOtherBlocks->blocks[i].first,
+                     theOtherBlocks->blocks[i].last);
+    PG_RETURN_POINTER(theBlocks);
+}
+
+PG_FUNCTION_INFO_V1(e164_blocks_agg_serialfn);
+Datum
+e164_blocks_agg_serialfn(PG_FUNCTION_ARGS)
+{
+    E164Blocks * theBlocks = (E164Blocks *) PG_GETARG_POINTER(0);
+    E164BlocksSummary * theSummary;
+
+    blocksCompact(theBlocks);
+    theSummary = palloc(E164BlocksSummarySize(theBlocks->numberOfBlocks));
+    SET_VARSIZE(theSummary, E164BlocksSummarySize(theBlocks->numberOfBlocks));
+    theSummary->numberOfBlocks = theBlocks->numberOfBlocks;
+    memcpy(theSummary->blocks, theBlocks->blocks,
+           theBlocks->numberOfBlocks * sizeof(E164Block));
+    PG_RETURN_BYTEA_P(theSummary);
+}
+
+PG_FUNCTION_INFO_V1(e164_blocks_agg_deserialfn);
+Datum
+e164_blocks_agg_deserialfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164BlocksSummary * theSummary;
+    E164Blocks * theBlocks;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_blocks_agg_deserialfn called in non-aggregate context");
+
+    theSummary = (E164BlocksSummary *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+    theBlocks = newBlocks(aggContext, theSummary->numberOfBlocks);
+    memcpy(theBlocks->blocks, theSummary->blocks,
+           theSummary->numberOfBlocks * sizeof(E164Block));
+    theBlocks->numberOfBlocks = theSummary->numberOfBlocks;
+    PG_RETURN_POINTER(theBlocks);
+}
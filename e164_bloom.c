@@ -0,0 +1,333 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Bloom filter aggregates
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "port/pg_bswap.h"
+#include "utils/memutils.h"
+#include "e164_base.h"
+
+/*
+ * e164_bloom_agg builds a Bloom filter of numbers as a bytea, which can be
+ * shipped to other nodes and probed with e164_bloom_contains, or merged
+ * with e164_bloom_union.  The k bit positions of a number are derived
+ * from the two halves of its e164Hash by double hashing, so building a
+ * filter costs one hash per number.
+ *
+ * The format is a version byte, k, two reserved bytes and the number of
+ * bits, big-endian, followed by the bits, bit n being bit (n % 8) of byte
+ * n / 8, so filters are portable between platforms.
+ */
+#define E164BloomVersion            1
+#define E164BloomMinimumBits        8
+#define E164BloomMaximumHashes      32
+
+typedef struct E164BloomFilter
+{
+    int32 vl_len_;
+    uint8 version;
+    uint8 numberOfHashes;
+    uint8 reserved[2];
+    uint32 numberOfBits;    /* big-endian */
+    uint8 bits[FLEXIBLE_ARRAY_MEMBER];
+} E164BloomFilter;
+
+#define E164BloomFilterSize(numberOfBits) \
+    (offsetof(E164BloomFilter, bits) + ((numberOfBits) + 7) / 8)
+
+Datum e164_bloom_agg_transfn(PG_FUNCTION_ARGS);
+Datum e164_bloom_agg_finalfn(PG_FUNCTION_ARGS);
+Datum e164_bloom_agg_combinefn(PG_FUNCTION_ARGS);
+Datum e164_bloom_agg_serialfn(PG_FUNCTION_ARGS);
+Datum e164_bloom_agg_deserialfn(PG_FUNCTION_ARGS);
+Datum e164_bloom_contains(PG_FUNCTION_ARGS);
+Datum e164_bloom_union(PG_FUNCTION_ARGS);
+
+static E164BloomFilter * newBloomFilter(MemoryContext aContext,
+                                        int32 numberOfBits,
+                                        int32 numberOfHashes);
+static E164BloomFilter * copyBloomFilter(MemoryContext aContext,
+                                         const E164BloomFilter * aFilter);
+static const E164BloomFilter * checkBloomFilter(const struct varlena * aValue);
+static void checkCompatibleBloomFilters(const E164BloomFilter * aFilter,
+                                        const E164BloomFilter * anotherFilter);
+static void bloomFilterUnion(E164BloomFilter * aFilter,
+                             const E164BloomFilter * anotherFilter);
+
+
+static E164BloomFilter *
+newBloomFilter(MemoryContext aContext, int32 numberOfBits, int32 numberOfHashes)
+{
+    E164BloomFilter * theFilter;
+
+    if (numberOfBits < E164BloomMinimumBits)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("Bloom filter must have at least %d bits",
+                        E164BloomMinimumBits)));
+    if (numberOfHashes < 1 || numberOfHashes > E164BloomMaximumHashes)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of Bloom filter hash functions must be between 1 and %d",
+                        E164BloomMaximumHashes)));
+
+    theFilter = MemoryContextAllocZero(aContext,
+                                       E164BloomFilterSize(numberOfBits));
+    SET_VARSIZE(theFilter, E164BloomFilterSize(numberOfBits));
+    theFilter->version = E164BloomVersion;
+    theFilter->numberOfHashes = numberOfHashes;
+    theFilter->numberOfBits = pg_hton32((uint32) numberOfBits);
+    return theFilter;
+}
+
+static E164BloomFilter *
+copyBloomFilter(MemoryContext aContext, const E164BloomFilter * aFilter)
+{
+    E164BloomFilter * theCopy = MemoryContextAlloc(aContext, VARSIZE(aFilter));
+
+    memcpy(theCopy, aFilter, VARSIZE(aFilter));
+    return theCopy;
+}
+
+/*
+ * checkBloomFilter returns aValue as a Bloom filter, after checking that it
+ * is one.
+ */
+static const E164BloomFilter *
+checkBloomFilter(const struct varlena * aValue)
+{
+    const E164BloomFilter * theFilter = (const E164BloomFilter *) aValue;
+    uint32 numberOfBits;
+
+    if (VARSIZE(aValue) < offsetof(E164BloomFilter, bits) ||
+        E164BloomVersion != theFilter->version)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid E164 Bloom filter")));
+    numberOfBits = pg_ntoh32(theFilter->numberOfBits);
+    if (numberOfBits < E164BloomMinimumBits ||
+        numberOfBits > PG_INT32_MAX ||
+        theFilter->numberOfHashes < 1 ||
+        theFilter->numberOfHashes > E164BloomMaximumHashes ||
+        VARSIZE(aValue) != E164BloomFilterSize(numberOfBits))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid E164 Bloom filter")));
+    return theFilter;
+}
+
+static void
+checkCompatibleBloomFilters(const E164BloomFilter * aFilter,
+                            const E164BloomFilter * anotherFilter)
+{
+    if (aFilter->numberOfBits != anotherFilter->numberOfBits ||
+        aFilter->numberOfHashes != anotherFilter->numberOfHashes)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("cannot combine Bloom filters of different sizes"),
+                 errdetail("The filters have %u bits and %d hashes, and %u bits and %d hashes.",
+                           pg_ntoh32(aFilter->numberOfBits),
+                           aFilter->numberOfHashes,
+                           pg_ntoh32(anotherFilter->numberOfBits),
+                           anotherFilter->numberOfHashes)));
+}
+
+static void
+bloomFilterUnion(E164BloomFilter * aFilter, const E164BloomFilter * anotherFilter)
+{
+    Size length = VARSIZE(aFilter) - offsetof(E164BloomFilter, bits);
+    Size i;
+
+    checkCompatibleBloomFilters(aFilter, anotherFilter);
+    for (i = 0; i < length; i++)
+        aFilter->bits[i] |= anotherFilter->bits[i];
+}
+
+/*
+ * The bits of a number are (h1 + i * h2) mod m for i in [0, k), where h1
+ * and h2 are the halves of its hash, h2 made odd so the positions differ.
+ */
+typedef struct E164BloomProbe
+{
+    uint64 h1;
+    uint64 h2;
+    uint64 numberOfBits;
+} E164BloomProbe;
+
+static inline void
+initBloomProbe(E164BloomProbe * aProbe, const E164BloomFilter * aFilter,
+               E164 aNumber)
+{
+    uint64 theHash = e164Hash(aNumber);
+
+    aProbe->h1 = theHash & UINT64CONST(0xFFFFFFFF);
+    aProbe->h2 = (theHash >> 32) | 1;
+    aProbe->numberOfBits = pg_ntoh32(aFilter->numberOfBits);
+}
+
+static inline uint64
+bloomProbeBit(const E164BloomProbe * aProbe, int i)
+{
+    return (aProbe->h1 + i * aProbe->h2) % aProbe->numberOfBits;
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_agg_transfn);
+Datum
+e164_bloom_agg_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164BloomFilter * theFilter;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_bloom_agg_transfn called in non-aggregate context");
+    if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
+        ereport(ERROR,
+                (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                 errmsg("Bloom filter size and number of hashes must not be null")));
+
+    if (PG_ARGISNULL(0))
+        theFilter = newBloomFilter(aggContext, PG_GETARG_INT32(2),
+                                   PG_GETARG_INT32(3));
+    else
+    {
+        theFilter = (E164BloomFilter *) PG_GETARG_POINTER(0);
+        if (pg_ntoh32(theFilter->numberOfBits) != (uint32) PG_GETARG_INT32(2) ||
+            theFilter->numberOfHashes != PG_GETARG_INT32(3))
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("Bloom filter size and number of hashes must be the same for every row")));
+    }
+
+    if (!PG_ARGISNULL(1))
+    {
+        E164BloomProbe theProbe;
+        int i;
+
+        initBloomProbe(&theProbe, theFilter, PG_GETARG_E164(1));
+        for (i = 0; i < theFilter->numberOfHashes; i++)
+        {
+            uint64 theBit = bloomProbeBit(&theProbe, i);
+
+            theFilter->bits[theBit / 8] |= (1 << (theBit % 8));
+        }
+    }
+    PG_RETURN_POINTER(theFilter);
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_agg_finalfn);
+Datum
+e164_bloom_agg_finalfn(PG_FUNCTION_ARGS)
+{
+    if (PG_ARGISNULL(0))
+        PG_RETURN_NULL();
+    PG_RETURN_BYTEA_P(copyBloomFilter(CurrentMemoryContext,
+                                      (E164BloomFilter *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_agg_combinefn);
+Datum
+e164_bloom_agg_combinefn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164BloomFilter * theFilter;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_bloom_agg_combinefn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    if (PG_ARGISNULL(0))
+        PG_RETURN_POINTER(copyBloomFilter(aggContext,
+                                          (E164BloomFilter *) PG_GETARG_POINTER(1)));
+
+    theFilter = (E164BloomFilter *) PG_GETARG_POINTER(0);
+    bloomFilterUnion(theFilter, (E164BloomFilter *) PG_GETARG_POINTER(1));
+    PG_RETURN_POINTER(theFilter);
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_agg_serialfn);
+Datum
+e164_bloom_agg_serialfn(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BYTEA_P(copyBloomFilter(CurrentMemoryContext,
+                                      (E164BloomFilter *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_agg_deserialfn);
+Datum
+e164_bloom_agg_deserialfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_bloom_agg_deserialfn called in non-aggregate context");
+
+    PG_RETURN_POINTER(copyBloomFilter(aggContext,
+                                      checkBloomFilter(PG_DETOAST_DATUM(PG_GETARG_DATUM(0)))));
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_contains);
+Datum
+e164_bloom_contains(PG_FUNCTION_ARGS)
+{
+    const E164BloomFilter * theFilter =
+        checkBloomFilter(e164StableArgument(fcinfo, 0));
+    E164BloomProbe theProbe;
+    int i;
+
+    initBloomProbe(&theProbe, theFilter, PG_GETARG_E164(1));
+    for (i = 0; i < theFilter->numberOfHashes; i++)
+    {
+        uint64 theBit = bloomProbeBit(&theProbe, i);
+
+        if (0 == (theFilter->bits[theBit / 8] & (1 << (theBit % 8))))
+            PG_RETURN_BOOL(false);
+    }
+    PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(e164_bloom_union);
+Datum
+e164_bloom_union(PG_FUNCTION_ARGS)
+{
+    const E164BloomFilter * theFilter =
+        checkBloomFilter(PG_DETOAST_DATUM(PG_GETARG_DATUM(0)));
+    E164BloomFilter * theUnion = copyBloomFilter(CurrentMemoryContext, theFilter);
+
+    bloomFilterUnion(theUnion,
+                     checkBloomFilter(PG_DETOAST_DATUM(PG_GETARG_DATUM(1))));
+    PG_RETURN_BYTEA_P(theUnion);
+}
@@ -0,0 +1,12 @@
+-- E164 bloom operator class installation SQL script, for databases in
+-- which contrib/bloom is installed after e164:
+--
+--     CREATE EXTENSION bloom;
+--     \i e164_bloom_ops.sql
+
+SET search_path = e164, public;
+
+CREATE OPERATOR CLASS bloom_e164_ops
+DEFAULT FOR TYPE e164 USING bloom
+AS OPERATOR 1 =(e164, e164)
+    , FUNCTION 1 e164_bloom_hash(e164);
@@ -0,0 +1,369 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Country code sets
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "e164_base.h"
+#include "e164_selfuncs.h"
+
+/*
+ * A ccset is a set of country codes, as a fixed-size bitmap with a bit
+ * for every possible country code, so membership is a single bit test.
+ * Bit n is bit (n % 8) of byte n / 8, which makes the layout independent
+ * of the platform, and the binary format simply the bitmap.
+ */
+#define CCSetNumberOfBits (E164_MAX_COUNTRY_CODE_VALUE + 1)
+#define CCSetLength       ((CCSetNumberOfBits + 7) / 8)
+
+typedef struct CCSet
+{
+    uint8 bits[CCSetLength];
+} CCSet;
+
+#define DatumGetCCSetP(X)    ((CCSet *) DatumGetPointer(X))
+#define CCSetPGetDatum(X)    PointerGetDatum(X)
+#define PG_GETARG_CCSET(n)   DatumGetCCSetP(PG_GETARG_DATUM(n))
+#define PG_RETURN_CCSET(x)   return CCSetPGetDatum(x)
+
+#define ccsetContains(aSet, aCountryCode) \
+    (0 != ((aSet)->bits[(aCountryCode) / 8] & (1 << ((aCountryCode) % 8))))
+
+Datum ccset_in(PG_FUNCTION_ARGS);
+Datum ccset_out(PG_FUNCTION_ARGS);
+Datum ccset_recv(PG_FUNCTION_ARGS);
+Datum ccset_send(PG_FUNCTION_ARGS);
+
+Datum ccset_overlaps(PG_FUNCTION_ARGS);
+Datum ccset_contains(PG_FUNCTION_ARGS);
+Datum ccset_contained(PG_FUNCTION_ARGS);
+Datum ccset_contains_e164(PG_FUNCTION_ARGS);
+Datum ccset_e164_contained(PG_FUNCTION_ARGS);
+Datum ccset_e164_containsel(PG_FUNCTION_ARGS);
+
+Datum ccset_add(PG_FUNCTION_ARGS);
+Datum ccset_union(PG_FUNCTION_ARGS);
+
+static void ccsetAdd(CCSet * aSet, E164CountryCode aCountryCode);
+static bool ccsetIsSubset(const CCSet * aSet, const CCSet * anotherSet);
+static CCSet * ccsetForUpdate(FunctionCallInfo fcinfo);
+
+
+/*
+ * ccsetAdd adds aCountryCode to aSet, after checking that it is a country
+ * code by the same rules as E164 input.
+ */
+static void
+ccsetAdd(CCSet * aSet, E164CountryCode aCountryCode)
+{
+    E164Type theType;
+
+    if (!e164CountryCodeIsInRange(aCountryCode))
+        ereport(ERROR,
+                (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                 errmsg("E164 country code out of range: %d", aCountryCode)));
+    theType = e164TypeForCountryCode(aCountryCode);
+    if (isInvalidE164Type(theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid E164 country code: %d", aCountryCode)));
+    if (isUnassignedE164Type(theType))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("unassigned E164 country code: %d", aCountryCode)));
+
+    aSet->bits[aCountryCode / 8] |= (1 << (aCountryCode % 8));
+}
+
+static bool
+ccsetIsSubset(const CCSet * aSet, const CCSet * anotherSet)
+{
+    int i;
+
+    for (i = 0; i < CCSetLength; i++)
+        if (aSet->bits[i] & ~anotherSet->bits[i])
+            return false;
+    return true;
+}
+
+/*
+ * ccsetForUpdate returns the ccset argument 0 to be modified: the argument
+ * itself when called as an aggregate transition function, as the state
+ * then lives in the aggregate context, and a copy otherwise.
+ */
+static CCSet *
+ccsetForUpdate(FunctionCallInfo fcinfo)
+{
+    CCSet * theSet = PG_GETARG_CCSET(0);
+    CCSet * theCopy;
+
+    if (AggCheckCallContext(fcinfo, NULL))
+        return theSet;
+    theCopy = palloc(sizeof(CCSet));
+    memcpy(theCopy, theSet, sizeof(CCSet));
+    return theCopy;
+}
+
+/*
+ * The text format is that of an integer array: {1,44,353}
+ */
+PG_FUNCTION_INFO_V1(ccset_in);
+Datum
+ccset_in(PG_FUNCTION_ARGS)
+{
+    char *  theString = PG_GETARG_CSTRING(0);
+    char *  theCharacter = theString;
+    CCSet * theSet = palloc0(sizeof(CCSet));
+
+    while (isspace((unsigned char) *theCharacter))
+        theCharacter++;
+    if ('{' != *theCharacter++)
+        goto bad_format;
+    while (isspace((unsigned char) *theCharacter))
+        theCharacter++;
+    if ('}' != *theCharacter)
+    {
+        for (;;)
+        {
+            char * theEnd;
+            long   theCountryCode;
+
+            if (!isdigit((unsigned char) *theCharacter))
+                goto bad_format;
+            errno = 0;
+            theCountryCode = strtol(theCharacter, &theEnd, 10);
+            if (ERANGE == errno || theCountryCode > PG_INT32_MAX)
+                theCountryCode = PG_INT32_MAX;
+            ccsetAdd(theSet, (E164CountryCode) theCountryCode);
+            theCharacter = theEnd;
+            while (isspace((unsigned char) *theCharacter))
+                theCharacter++;
+            if ('}' == *theCharacter)
+                break;
+            if (',' != *theCharacter++)
+                goto bad_format;
+            while (isspace((unsigned char) *theCharacter))
+                theCharacter++;
+        }
+    }
+    theCharacter++;
+    while (isspace((unsigned char) *theCharacter))
+        theCharacter++;
+    if ('\0' != *theCharacter)
+        goto bad_format;
+
+    PG_RETURN_CCSET(theSet);
+
+bad_format:
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+             errmsg("invalid input syntax for type ccset: \"%s\"", theString),
+             errhint("Country code sets are written as {1,44,353}.")));
+    PG_RETURN_NULL(); /* keep compiler quiet */
+}
+
+PG_FUNCTION_INFO_V1(ccset_out);
+Datum
+ccset_out(PG_FUNCTION_ARGS)
+{
+    CCSet *        theSet = PG_GETARG_CCSET(0);
+    StringInfoData theString;
+    int            theCountryCode;
+    bool           isFirst = true;
+
+    initStringInfo(&theString);
+    appendStringInfoChar(&theString, '{');
+    for (theCountryCode = 0; theCountryCode < CCSetNumberOfBits; theCountryCode++)
+    {
+        if (!ccsetContains(theSet, theCountryCode))
+            continue;
+        if (!isFirst)
+            appendStringInfoChar(&theString, ',');
+        appendStringInfo(&theString, "%d", theCountryCode);
+        isFirst = false;
+    }
+    appendStringInfoChar(&theString, '}');
+    PG_RETURN_CSTRING(theString.data);
+}
+
+PG_FUNCTION_INFO_V1(ccset_recv);
+Datum
+ccset_recv(PG_FUNCTION_ARGS)
+{
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    CCSet *    theSet = palloc(sizeof(CCSet));
+    CCSet *    theCheckedSet = palloc0(sizeof(CCSet));
+    int        theCountryCode;
+
+    pq_copymsgbytes(buf, (char *) theSet->bits, CCSetLength);
+    /* Don't take the country codes on trust */
+    for (theCountryCode = 0; theCountryCode < CCSetNumberOfBits; theCountryCode++)
+        if (ccsetContains(theSet, theCountryCode))
+            ccsetAdd(theCheckedSet, theCountryCode);
+    pfree(theSet);
+    PG_RETURN_CCSET(theCheckedSet);
+}
+
+PG_FUNCTION_INFO_V1(ccset_send);
+Datum
+ccset_send(PG_FUNCTION_ARGS)
+{
+    CCSet *        theSet = PG_GETARG_CCSET(0);
+    StringInfoData buf;
+
+    pq_begintypsend(&buf);
+    pq_sendbytes(&buf, (char *) theSet->bits, CCSetLength);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(ccset_overlaps);
+Datum
+ccset_overlaps(PG_FUNCTION_ARGS)
+{
+    CCSet * firstSet = PG_GETARG_CCSET(0);
+    CCSet * secondSet = PG_GETARG_CCSET(1);
+    int     i;
+
+    for (i = 0; i < CCSetLength; i++)
+        if (firstSet->bits[i] & secondSet->bits[i])
+            PG_RETURN_BOOL(true);
+    PG_RETURN_BOOL(false);
+}
+
+PG_FUNCTION_INFO_V1(ccset_contains);
+Datum
+ccset_contains(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(ccsetIsSubset(PG_GETARG_CCSET(1), PG_GETARG_CCSET(0)));
+}
+
+PG_FUNCTION_INFO_V1(ccset_contained);
+Datum
+ccset_contained(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(ccsetIsSubset(PG_GETARG_CCSET(0), PG_GETARG_CCSET(1)));
+}
+
+PG_FUNCTION_INFO_V1(ccset_contains_e164);
+Datum
+ccset_contains_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(ccsetContains(PG_GETARG_CCSET(0),
+                                 countryCodeOfE164(PG_GETARG_E164(1))));
+}
+
+PG_FUNCTION_INFO_V1(ccset_e164_contained);
+Datum
+ccset_e164_contained(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(ccsetContains(PG_GETARG_CCSET(1),
+                                 countryCodeOfE164(PG_GETARG_E164(0))));
+}
+
+/*
+ * ccset_e164_containsel estimates set @> n and n <@ set, for a constant
+ * set, as the fraction of rows in its country codes, from the country code
+ * statistics of n.  Otherwise, contsel is used.
+ */
+PG_FUNCTION_INFO_V1(ccset_e164_containsel);
+Datum
+ccset_e164_containsel(PG_FUNCTION_ARGS)
+{
+    PlannerInfo * root = (PlannerInfo *) PG_GETARG_POINTER(0);
+    List *        args = (List *) PG_GETARG_POINTER(2);
+    int           varRelid = PG_GETARG_INT32(3);
+    float8        theSelectivity = 0.0;
+    VariableStatData vardata;
+    Node *        other;
+    bool          varonleft;
+    float8        frequencies[E164_MAX_COUNTRY_CODE_VALUE + 1];
+    CCSet *       theSet;
+    int           i;
+
+    if (!get_restriction_variable(root, args, varRelid,
+                                  &vardata, &other, &varonleft))
+        return DirectFunctionCall4(contsel,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3));
+
+    /* The constant is the set, of fixed length, when the variable is n */
+    if (!IsA(other, Const) || sizeof(CCSet) != ((Const *) other)->constlen ||
+        !e164CountryCodeFrequencies(&vardata, frequencies))
+    {
+        ReleaseVariableStats(vardata);
+        return DirectFunctionCall4(contsel,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3));
+    }
+
+    if (!((Const *) other)->constisnull)
+    {
+        theSet = DatumGetCCSetP(((Const *) other)->constvalue);
+        for (i = 0; i <= E164_MAX_COUNTRY_CODE_VALUE; i++)
+            if (ccsetContains(theSet, i))
+                theSelectivity += frequencies[i];
+    }
+
+    ReleaseVariableStats(vardata);
+    CLAMP_PROBABILITY(theSelectivity);
+    PG_RETURN_FLOAT8(theSelectivity);
+}
+
+/*
+ * ccset_add and ccset_union are also the transition functions of the
+ * ccset_agg and ccset_union_agg aggregates, ccset_union being the combine
+ * function of both.
+ */
+PG_FUNCTION_INFO_V1(ccset_add);
+Datum
+ccset_add(PG_FUNCTION_ARGS)
+{
+    CCSet * theSet = ccsetForUpdate(fcinfo);
+    E164CountryCode theCountryCode = countryCodeOfE164(PG_GETARG_E164(1));
+
+    theSet->bits[theCountryCode / 8] |= (1 << (theCountryCode % 8));
+    PG_RETURN_CCSET(theSet);
+}
+
+PG_FUNCTION_INFO_V1(ccset_union);
+Datum
+ccset_union(PG_FUNCTION_ARGS)
+{
+    CCSet * theSet = ccsetForUpdate(fcinfo);
+    CCSet * theOtherSet = PG_GETARG_CCSET(1);
+    int     i;
+
+    for (i = 0; i < CCSetLength; i++)
+        theSet->bits[i] |= theOtherSet->bits[i];
+    PG_RETURN_CCSET(theSet);
+}
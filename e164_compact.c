@@ -0,0 +1,255 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Compact storage type
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "access/hash.h"
+#include "libpq/pqformat.h"
+#include "e164_base.h"
+
+/*
+ * e164c is an on-disk alternative to e164 for very large tables: the digits
+ * of the number, country code included, in seven big-endian bytes with no
+ * alignment requirement.  The cached country code of e164 is left out, as
+ * it can be recovered from the digits (see e164FromDigits), which is done
+ * whenever an e164c is used as an e164.  The byte order makes equal
+ * numbers have equal representations, but does not give the e164 order,
+ * which sorts by country code first.
+ */
+#define E164CompactLength 7
+
+typedef struct E164Compact
+{
+    uint8 digits[E164CompactLength];
+} E164Compact;
+
+#define DatumGetE164CompactP(X)  ((E164Compact *) DatumGetPointer(X))
+#define E164CompactPGetDatum(X)  PointerGetDatum(X)
+#define PG_GETARG_E164C(n)       DatumGetE164CompactP(PG_GETARG_DATUM(n))
+#define PG_RETURN_E164C(x)       return E164CompactPGetDatum(x)
+
+Datum e164c_in(PG_FUNCTION_ARGS);
+Datum e164c_out(PG_FUNCTION_ARGS);
+Datum e164c_recv(PG_FUNCTION_ARGS);
+Datum e164c_send(PG_FUNCTION_ARGS);
+
+Datum e164c_to_e164(PG_FUNCTION_ARGS);
+Datum e164_to_e164c(PG_FUNCTION_ARGS);
+
+Datum e164c_lt(PG_FUNCTION_ARGS);
+Datum e164c_le(PG_FUNCTION_ARGS);
+Datum e164c_eq(PG_FUNCTION_ARGS);
+Datum e164c_ge(PG_FUNCTION_ARGS);
+Datum e164c_gt(PG_FUNCTION_ARGS);
+Datum e164c_ne(PG_FUNCTION_ARGS);
+Datum e164c_cmp(PG_FUNCTION_ARGS);
+Datum e164c_hash(PG_FUNCTION_ARGS);
+
+static E164Compact * e164CompactFromE164(E164 aNumber);
+static uint64 digitsOfE164Compact(const E164Compact * aNumber);
+static E164 e164FromE164Compact(const E164Compact * aNumber);
+static int64 e164CompactComparison(const E164Compact * firstNumber,
+                                   const E164Compact * secondNumber);
+
+
+static E164Compact *
+e164CompactFromE164(E164 aNumber)
+{
+    E164Compact * theNumber = palloc(sizeof(E164Compact));
+    uint64 theDigits = e164DigitsOf(aNumber);
+    int i;
+
+    for (i = E164CompactLength - 1; i >= 0; i--)
+    {
+        theNumber->digits[i] = theDigits & 0xFF;
+        theDigits >>= 8;
+    }
+    return theNumber;
+}
+
+static uint64
+digitsOfE164Compact(const E164Compact * aNumber)
+{
+    uint64 theDigits = 0;
+    int i;
+
+    for (i = 0; i < E164CompactLength; i++)
+        theDigits = (theDigits << 8) | aNumber->digits[i];
+    return theDigits;
+}
+
+static E164
+e164FromE164Compact(const E164Compact * aNumber)
+{
+    return e164FromDigits(digitsOfE164Compact(aNumber));
+}
+
+/*
+ * Comparisons and hashes only need the value of a number, not a checked
+ * one: the digits were checked on the way in, so they recover the country
+ * code with e164ValueOfDigits, without the validation of e164FromDigits.
+ */
+static int64
+e164CompactComparison(const E164Compact * firstNumber,
+                      const E164Compact * secondNumber)
+{
+    uint64 firstDigits = digitsOfE164Compact(firstNumber);
+    uint64 secondDigits = digitsOfE164Compact(secondNumber);
+
+    if (firstDigits == secondDigits)
+        return 0;
+    return ((int64) e164ValueOfDigits(firstDigits) -
+            (int64) e164ValueOfDigits(secondDigits));
+}
+
+PG_FUNCTION_INFO_V1(e164c_in);
+Datum
+e164c_in(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164C(e164CompactFromE164(e164FromString(PG_GETARG_CSTRING(0))));
+}
+
+PG_FUNCTION_INFO_V1(e164c_out);
+Datum
+e164c_out(PG_FUNCTION_ARGS)
+{
+    E164	theNumber = e164FromE164Compact(PG_GETARG_E164C(0));
+    char * theString = palloc(E164MaximumStringLength + 1);
+    (void) stringFromE164(theString, E164MaximumStringLength + 1, theNumber);
+    PG_RETURN_CSTRING(theString);
+}
+
+/*
+ * The binary format is the digits as an int8, which doesn't depend on the
+ * layout of either type.
+ */
+PG_FUNCTION_INFO_V1(e164c_recv);
+Datum
+e164c_recv(PG_FUNCTION_ARGS)
+{
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    uint64 theDigits = (uint64) pq_getmsgint64(buf);
+    PG_RETURN_E164C(e164CompactFromE164(e164FromDigits(theDigits)));
+}
+
+PG_FUNCTION_INFO_V1(e164c_send);
+Datum
+e164c_send(PG_FUNCTION_ARGS)
+{
+    E164 theNumber = e164FromE164Compact(PG_GETARG_E164C(0));
+    StringInfoData buf;
+
+    pq_begintypsend(&buf);
+    pq_sendint64(&buf, (int64) e164DigitsOf(theNumber));
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(e164c_to_e164);
+Datum
+e164c_to_e164(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164(e164FromE164Compact(PG_GETARG_E164C(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_to_e164c);
+Datum
+e164_to_e164c(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164C(e164CompactFromE164(PG_GETARG_E164(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164c_lt);
+Datum
+e164c_lt(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 > e164CompactComparison(PG_GETARG_E164C(0),
+                                             PG_GETARG_E164C(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164c_le);
+Datum
+e164c_le(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 >= e164CompactComparison(PG_GETARG_E164C(0),
+                                              PG_GETARG_E164C(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164c_eq);
+Datum
+e164c_eq(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 == memcmp(PG_GETARG_E164C(0)->digits,
+                               PG_GETARG_E164C(1)->digits,
+                               E164CompactLength));
+}
+
+PG_FUNCTION_INFO_V1(e164c_ge);
+Datum
+e164c_ge(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 <= e164CompactComparison(PG_GETARG_E164C(0),
+                                              PG_GETARG_E164C(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164c_gt);
+Datum
+e164c_gt(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 < e164CompactComparison(PG_GETARG_E164C(0),
+                                             PG_GETARG_E164C(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164c_ne);
+Datum
+e164c_ne(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(0 != memcmp(PG_GETARG_E164C(0)->digits,
+                               PG_GETARG_E164C(1)->digits,
+                               E164CompactLength));
+}
+
+PG_FUNCTION_INFO_V1(e164c_cmp);
+Datum
+e164c_cmp(PG_FUNCTION_ARGS)
+{
+    int64 comparison = e164CompactComparison(PG_GETARG_E164C(0),
+                                             PG_GETARG_E164C(1));
+    PG_RETURN_INT32((comparison > 0) - (comparison < 0));
+}
+
+/* Hashes the same as e164_hash, so equal e164 and e164c values agree */
+PG_FUNCTION_INFO_V1(e164c_hash);
+Datum
+e164c_hash(PG_FUNCTION_ARGS)
+{
+    E164 theNumber = e164ValueOfDigits(digitsOfE164Compact(PG_GETARG_E164C(0)));
+    return hash_any((unsigned char *) &theNumber, sizeof(E164));
+}
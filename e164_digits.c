@@ -0,0 +1,272 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Digit patterns and n-grams
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "e164_digits.h"
+
+/*
+ * Digit grams, as stored in the GIN index: every run of three consecutive
+ * digits as its value (0-999), and the first and last two digits of the
+ * number, offset so they don't collide with the trigrams or each other.
+ * The anchored grams are what make a pattern such as "+4420%" selective,
+ * as its only trigram, "442", is shared with every number in which the
+ * digits occur anywhere.
+ */
+#define E164DigitGramStartOffset 1000
+#define E164DigitGramEndOffset   1100
+
+static inline bool isIgnoredPatternCharacter(char aCharacter);
+static int  addTrigramsOf(const char * digits, int numberOfDigits,
+                          int32 * grams);
+
+
+static inline bool
+isIgnoredPatternCharacter(char aCharacter)
+{
+    return (' ' == aCharacter || '-' == aCharacter ||
+            '(' == aCharacter || ')' == aCharacter);
+}
+
+/*
+ * parseE164DigitPattern parses a LIKE-style pattern over the digits of a
+ * number, including the country code: "?" matches any one digit and "%"
+ * any run of digits, possibly empty.  The pattern is anchored at both
+ * ends.  A leading "+" and spaces, hyphens and parentheses, as used when
+ * writing numbers, are ignored.
+ */
+void
+parseE164DigitPattern(const char * aString, E164DigitPattern * aPattern)
+{
+    const char * theCharacter = aString;
+    int numberOfDigits = 0;
+
+    aPattern->length = 0;
+    if ('+' == *theCharacter)
+        theCharacter++;
+    for (; '\0' != *theCharacter; theCharacter++)
+    {
+        char theSymbol = *theCharacter;
+
+        if (isIgnoredPatternCharacter(theSymbol))
+            continue;
+        if (E164DigitPatternAnyDigits == theSymbol)
+        {
+            if (aPattern->length > 0 &&
+                E164DigitPatternAnyDigits ==
+                aPattern->symbols[aPattern->length - 1])
+                continue;
+        }
+        else if (isdigit((unsigned char) theSymbol) ||
+                 E164DigitPatternAnyDigit == theSymbol)
+        {
+            if (++numberOfDigits > E164MaximumNumberOfDigits)
+                ereport(ERROR,
+                        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                         errmsg("E164 digit pattern is too long: \"%s\"",
+                                aString),
+                         errdetail("E164 numbers have at most %d digits.",
+                                   E164MaximumNumberOfDigits)));
+        }
+        else
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("invalid E164 digit pattern: \"%s\"", aString),
+                     errhint("Digit patterns consist of digits, \"?\" "
+                             "matching any digit and \"%%\" matching any "
+                             "run of digits.")));
+        aPattern->symbols[aPattern->length++] = theSymbol;
+    }
+}
+
+/*
+ * parseE164DigitPrefix parses the leading digits of a number, country code
+ * included, written as a number is, e.g., "+1 415", as the digit pattern
+ * matching the numbers they begin: the digits followed by "%".
+ */
+void
+parseE164DigitPrefix(const char * aString, E164DigitPattern * aPattern)
+{
+    const char * theCharacter = aString;
+
+    aPattern->length = 0;
+    if ('+' == *theCharacter)
+        theCharacter++;
+    for (; '\0' != *theCharacter; theCharacter++)
+    {
+        if (isIgnoredPatternCharacter(*theCharacter))
+            continue;
+        if (!isdigit((unsigned char) *theCharacter))
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("invalid E164 digit prefix: \"%s\"", aString),
+                     errhint("Digit prefixes consist of digits only.")));
+        if (aPattern->length == E164MaximumNumberOfDigits)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("E164 digit prefix is too long: \"%s\"",
+                            aString),
+                     errdetail("E164 numbers have at most %d digits.",
+                               E164MaximumNumberOfDigits)));
+        aPattern->symbols[aPattern->length++] = *theCharacter;
+    }
+    aPattern->symbols[aPattern->length++] = E164DigitPatternAnyDigits;
+}
+
+/*
+ * e164MatchesDigitPattern returns whether the digits of aNumber match
+ * aPattern.  On a mismatch after a "%", the "%" is made to absorb one more
+ * digit and matching resumes from there; as runs of "%" are collapsed and
+ * numbers are short, this never does much work.
+ */
+bool
+e164MatchesDigitPattern(E164 aNumber, const E164DigitPattern * aPattern)
+{
+    uint8 digits[E164MaximumNumberOfDigits];
+    int numberOfDigits = digitsFromE164(digits, aNumber);
+    const char * symbols = aPattern->symbols;
+    int patternLength = aPattern->length;
+    int digit = 0;
+    int symbol = 0;
+    int lastAnyDigits = -1;
+    int lastAnyDigitsDigit = 0;
+
+    while (digit < numberOfDigits)
+    {
+        if (symbol < patternLength &&
+            (E164DigitPatternAnyDigit == symbols[symbol] ||
+             symbols[symbol] - '0' == digits[digit]))
+        {
+            digit++;
+            symbol++;
+        }
+        else if (symbol < patternLength &&
+                 E164DigitPatternAnyDigits == symbols[symbol])
+        {
+            lastAnyDigits = symbol++;
+            lastAnyDigitsDigit = digit;
+        }
+        else if (lastAnyDigits >= 0)
+        {
+            symbol = lastAnyDigits + 1;
+            digit = ++lastAnyDigitsDigit;
+        }
+        else
+            return false;
+    }
+    while (symbol < patternLength &&
+           E164DigitPatternAnyDigits == symbols[symbol])
+        symbol++;
+    return (symbol == patternLength);
+}
+
+/*
+ * addTrigramsOf assigns the trigrams of a run of digits, given as
+ * characters, to grams, returning the number assigned.
+ */
+static int
+addTrigramsOf(const char * digits, int numberOfDigits, int32 * grams)
+{
+    int numberOfGrams = 0;
+    int i;
+
+    for (i = 0; i + 2 < numberOfDigits; i++)
+        grams[numberOfGrams++] = ((digits[i] - '0') * 100 +
+                                  (digits[i + 1] - '0') * 10 +
+                                  (digits[i + 2] - '0'));
+    return numberOfGrams;
+}
+
+/*
+ * e164DigitGramsOf assigns the digit grams of aNumber to grams, which must
+ * have room for E164MaximumNumberOfDigitGrams, returning the number
+ * assigned.  Grams may repeat.
+ */
+int
+e164DigitGramsOf(E164 aNumber, int32 * grams)
+{
+    uint8 digits[E164MaximumNumberOfDigits];
+    char  digitCharacters[E164MaximumNumberOfDigits];
+    int numberOfDigits = digitsFromE164(digits, aNumber);
+    int numberOfGrams;
+    int i;
+
+    for (i = 0; i < numberOfDigits; i++)
+        digitCharacters[i] = '0' + digits[i];
+    numberOfGrams = addTrigramsOf(digitCharacters, numberOfDigits, grams);
+    /* Every valid number has at least a country code digit and one more */
+    grams[numberOfGrams++] = (E164DigitGramStartOffset +
+                              digits[0] * 10 + digits[1]);
+    grams[numberOfGrams++] = (E164DigitGramEndOffset +
+                              digits[numberOfDigits - 2] * 10 +
+                              digits[numberOfDigits - 1]);
+    return numberOfGrams;
+}
+
+/*
+ * e164DigitPatternGramsOf assigns to grams the digit grams every number
+ * matching aPattern must have, returning the number assigned: the
+ * trigrams of each run of literal digits, and the start and end grams
+ * where the pattern is anchored by a run of at least two digits.  A
+ * pattern may well have no grams at all, in which case every number is a
+ * candidate.
+ */
+int
+e164DigitPatternGramsOf(const E164DigitPattern * aPattern, int32 * grams)
+{
+    const char * symbols = aPattern->symbols;
+    int patternLength = aPattern->length;
+    int numberOfGrams = 0;
+    int runStart = 0;
+    int i;
+
+    for (i = 0; i <= patternLength; i++)
+    {
+        int runLength;
+
+        if (i < patternLength && isdigit((unsigned char) symbols[i]))
+            continue;
+
+        runLength = i - runStart;
+        numberOfGrams += addTrigramsOf(symbols + runStart, runLength,
+                                       grams + numberOfGrams);
+        if (runLength >= 2 && 0 == runStart)
+            grams[numberOfGrams++] = (E164DigitGramStartOffset +
+                                      (symbols[0] - '0') * 10 +
+                                      (symbols[1] - '0'));
+        if (runLength >= 2 && patternLength == i)
+            grams[numberOfGrams++] = (E164DigitGramEndOffset +
+                                      (symbols[i - 2] - '0') * 10 +
+                                      (symbols[i - 1] - '0'));
+        runStart = i + 1;
+    }
+    return numberOfGrams;
+}
@@ -0,0 +1,71 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Digit patterns and n-grams
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef E164_DIGITS_H
+#define E164_DIGITS_H
+
+#include "e164_base.h"
+
+#define E164DigitPatternAnyDigit  '?'
+#define E164DigitPatternAnyDigits '%'
+
+/* A digit or "?", possibly preceded by "%", for every digit, and a trailing "%" */
+#define E164DigitPatternMaximumLength (2 * E164MaximumNumberOfDigits + 1)
+
+/*
+ * A parsed digit pattern: digits ('0'-'9') and wildcards only, with runs
+ * of "%" collapsed.
+ */
+typedef struct E164DigitPattern
+{
+    int  length;
+    char symbols[E164DigitPatternMaximumLength];
+} E164DigitPattern;
+
+/*
+ * Neither a number nor a pattern produces more than this many grams: one
+ * trigram per digit but the last two, plus the start and end grams.
+ */
+#define E164MaximumNumberOfDigitGrams E164MaximumNumberOfDigits
+
+extern void parseE164DigitPattern(const char * aString,
+                                  E164DigitPattern * aPattern);
+extern void parseE164DigitPrefix(const char * aString,
+                                 E164DigitPattern * aPattern);
+extern bool e164MatchesDigitPattern(E164 aNumber,
+                                    const E164DigitPattern * aPattern);
+
+extern int e164DigitGramsOf(E164 aNumber, int32 * grams);
+extern int e164DigitPatternGramsOf(const E164DigitPattern * aPattern,
+                                   int32 * grams);
+
+#endif /* !E164_DIGITS_H */
@@ -0,0 +1,340 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: GIN operator classes
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "access/gin.h"
+#include "fmgr.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "e164_base.h"
+#include "e164_digits.h"
+
+/*
+ * The GIN operator class for e164[] indexes the array elements as plain
+ * e164 keys.  The array strategies are handled by the core array support
+ * functions; on top of those, an array @> e164 strategy answers "which
+ * arrays contain this number", the indexable spelling of n = ANY (array).
+ */
+#define E164GinContainsElementStrategyNumber 5
+
+/*
+ * The digit n-gram operator class answers ~# (strategy 1) and ^@
+ * (strategy 2), a prefix being searched as the pattern it parses to.
+ */
+#define E164GinDigitPrefixStrategyNumber 2
+
+Datum e164_array_contains(PG_FUNCTION_ARGS);
+Datum e164_array_contained(PG_FUNCTION_ARGS);
+
+Datum e164_gin_extract_query(PG_FUNCTION_ARGS);
+Datum e164_gin_consistent(PG_FUNCTION_ARGS);
+Datum e164_gin_triconsistent(PG_FUNCTION_ARGS);
+
+Datum e164_digits_match(PG_FUNCTION_ARGS);
+Datum e164_starts_with(PG_FUNCTION_ARGS);
+
+Datum e164_gin_extract_digit_grams(PG_FUNCTION_ARGS);
+Datum e164_gin_extract_digit_pattern(PG_FUNCTION_ARGS);
+Datum e164_gin_digit_pattern_consistent(PG_FUNCTION_ARGS);
+Datum e164_gin_digit_pattern_triconsistent(PG_FUNCTION_ARGS);
+
+/*
+ * The parsed form of the last digit pattern seen by a call site, so a
+ * constant pattern is parsed once per query rather than once per row.
+ */
+typedef struct E164DigitPatternCache
+{
+    text *           source;
+    E164DigitPattern pattern;
+} E164DigitPatternCache;
+
+static bool arrayContainsE164(ArrayType * anArray, E164 aNumber);
+static const E164DigitPattern * cachedDigitPattern(FunctionCallInfo fcinfo,
+                                                   text * aPattern,
+                                                   bool isPrefix);
+static int  compareDigitGrams(const void * a, const void * b);
+static Datum * digitGramDatums(int32 * grams, int numberOfGrams,
+                               int32 * nkeys);
+
+
+static bool
+arrayContainsE164(ArrayType * anArray, E164 aNumber)
+{
+    Datum * elements;
+    bool *  nulls;
+    int     numberOfElements;
+    int     i;
+
+    deconstruct_array(anArray, ARR_ELEMTYPE(anArray),
+                      sizeof(E164), FLOAT8PASSBYVAL, 'd',
+                      &elements, &nulls, &numberOfElements);
+
+    for (i = 0; i < numberOfElements; ++i)
+        if (!nulls[i] &&
+            e164Comparison(DatumGetE164P(elements[i]), aNumber) == 0)
+            return true;
+
+    return false;
+}
+
+PG_FUNCTION_INFO_V1(e164_array_contains);
+Datum
+e164_array_contains(PG_FUNCTION_ARGS)
+{
+    ArrayType * theArray = PG_GETARG_ARRAYTYPE_P(0);
+    bool        result = arrayContainsE164(theArray, PG_GETARG_E164(1));
+
+    PG_FREE_IF_COPY(theArray, 0);
+    PG_RETURN_BOOL(result);
+}
+
+PG_FUNCTION_INFO_V1(e164_array_contained);
+Datum
+e164_array_contained(PG_FUNCTION_ARGS)
+{
+    ArrayType * theArray = PG_GETARG_ARRAYTYPE_P(1);
+    bool        result = arrayContainsE164(theArray, PG_GETARG_E164(0));
+
+    PG_FREE_IF_COPY(theArray, 1);
+    PG_RETURN_BOOL(result);
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_extract_query);
+Datum
+e164_gin_extract_query(PG_FUNCTION_ARGS)
+{
+    int32 *        nkeys = (int32 *) PG_GETARG_POINTER(1);
+    StrategyNumber strategy = PG_GETARG_UINT16(2);
+    bool **        nullFlags = (bool **) PG_GETARG_POINTER(5);
+    int32 *        searchMode = (int32 *) PG_GETARG_POINTER(6);
+    Datum *        keys;
+
+    if (strategy != E164GinContainsElementStrategyNumber)
+        return DirectFunctionCall7(ginqueryarrayextract,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3),
+                                   PG_GETARG_DATUM(4), PG_GETARG_DATUM(5),
+                                   PG_GETARG_DATUM(6));
+
+    keys = palloc(sizeof(Datum));
+    keys[0] = E164PGetDatum(PG_GETARG_E164(0));
+    *nkeys = 1;
+    *nullFlags = palloc0(sizeof(bool));
+    *searchMode = GIN_SEARCH_MODE_DEFAULT;
+    PG_RETURN_POINTER(keys);
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_consistent);
+Datum
+e164_gin_consistent(PG_FUNCTION_ARGS)
+{
+    bool *         check = (bool *) PG_GETARG_POINTER(0);
+    StrategyNumber strategy = PG_GETARG_UINT16(1);
+    bool *         recheck = (bool *) PG_GETARG_POINTER(5);
+
+    if (strategy != E164GinContainsElementStrategyNumber)
+        return DirectFunctionCall8(ginarrayconsistent,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3),
+                                   PG_GETARG_DATUM(4), PG_GETARG_DATUM(5),
+                                   PG_GETARG_DATUM(6), PG_GETARG_DATUM(7));
+
+    /* The single key is the number itself, so a match is exact. */
+    *recheck = false;
+    PG_RETURN_BOOL(check[0]);
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_triconsistent);
+Datum
+e164_gin_triconsistent(PG_FUNCTION_ARGS)
+{
+    GinTernaryValue * check = (GinTernaryValue *) PG_GETARG_POINTER(0);
+    StrategyNumber    strategy = PG_GETARG_UINT16(1);
+
+    if (strategy != E164GinContainsElementStrategyNumber)
+        return DirectFunctionCall7(ginarraytriconsistent,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3),
+                                   PG_GETARG_DATUM(4), PG_GETARG_DATUM(5),
+                                   PG_GETARG_DATUM(6));
+
+    PG_RETURN_GIN_TERNARY_VALUE(check[0]);
+}
+
+/*
+ * cachedDigitPattern returns the parsed form of aPattern, parsed as a
+ * digit prefix if isPrefix; a call site always parses the same way.
+ */
+static const E164DigitPattern *
+cachedDigitPattern(FunctionCallInfo fcinfo, text * aPattern, bool isPrefix)
+{
+    E164DigitPatternCache * theCache = fcinfo->flinfo->fn_extra;
+    Size theSize = VARSIZE_ANY(aPattern);
+
+    if (NULL == theCache)
+    {
+        theCache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+                                          sizeof(E164DigitPatternCache));
+        fcinfo->flinfo->fn_extra = theCache;
+    }
+    else if (VARSIZE_ANY(theCache->source) == theSize &&
+             0 == memcmp(theCache->source, aPattern, theSize))
+        return &theCache->pattern;
+
+    if (NULL != theCache->source)
+        pfree(theCache->source);
+    theCache->source = NULL;
+    if (isPrefix)
+        parseE164DigitPrefix(text_to_cstring(aPattern), &theCache->pattern);
+    else
+        parseE164DigitPattern(text_to_cstring(aPattern), &theCache->pattern);
+    theCache->source = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, theSize);
+    memcpy(theCache->source, aPattern, theSize);
+    return &theCache->pattern;
+}
+
+PG_FUNCTION_INFO_V1(e164_digits_match);
+Datum
+e164_digits_match(PG_FUNCTION_ARGS)
+{
+    E164 theNumber = PG_GETARG_E164(0);
+    const E164DigitPattern * thePattern =
+        cachedDigitPattern(fcinfo, PG_GETARG_TEXT_PP(1), false);
+
+    PG_RETURN_BOOL(e164MatchesDigitPattern(theNumber, thePattern));
+}
+
+PG_FUNCTION_INFO_V1(e164_starts_with);
+Datum
+e164_starts_with(PG_FUNCTION_ARGS)
+{
+    E164 theNumber = PG_GETARG_E164(0);
+    const E164DigitPattern * thePattern =
+        cachedDigitPattern(fcinfo, PG_GETARG_TEXT_PP(1), true);
+
+    PG_RETURN_BOOL(e164MatchesDigitPattern(theNumber, thePattern));
+}
+
+/*
+ * The digit n-gram GIN operator class indexes each number under its digit
+ * grams (see e164_digits.c), so a ~# search only visits numbers having
+ * every gram of the pattern.  The grams say nothing about where in the
+ * number they occur, so matches are always rechecked.
+ */
+static int
+compareDigitGrams(const void * a, const void * b)
+{
+    int32 first = *(const int32 *) a;
+    int32 second = *(const int32 *) b;
+
+    return (first > second) - (first < second);
+}
+
+static Datum *
+digitGramDatums(int32 * grams, int numberOfGrams, int32 * nkeys)
+{
+    Datum * keys = palloc(sizeof(Datum) * Max(numberOfGrams, 1));
+    int numberOfKeys = 0;
+    int i;
+
+    qsort(grams, numberOfGrams, sizeof(int32), compareDigitGrams);
+    for (i = 0; i < numberOfGrams; i++)
+        if (0 == i || grams[i] != grams[i - 1])
+            keys[numberOfKeys++] = Int32GetDatum(grams[i]);
+    *nkeys = numberOfKeys;
+    return keys;
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_extract_digit_grams);
+Datum
+e164_gin_extract_digit_grams(PG_FUNCTION_ARGS)
+{
+    E164    theNumber = PG_GETARG_E164(0);
+    int32 * nkeys = (int32 *) PG_GETARG_POINTER(1);
+    int32   grams[E164MaximumNumberOfDigitGrams];
+    int     numberOfGrams = e164DigitGramsOf(theNumber, grams);
+
+    PG_RETURN_POINTER(digitGramDatums(grams, numberOfGrams, nkeys));
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_extract_digit_pattern);
+Datum
+e164_gin_extract_digit_pattern(PG_FUNCTION_ARGS)
+{
+    int32 *          nkeys = (int32 *) PG_GETARG_POINTER(1);
+    StrategyNumber   strategy = PG_GETARG_UINT16(2);
+    int32 *          searchMode = (int32 *) PG_GETARG_POINTER(6);
+    char *           theString = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    E164DigitPattern thePattern;
+    int32            grams[E164MaximumNumberOfDigitGrams];
+    int              numberOfGrams;
+
+    if (E164GinDigitPrefixStrategyNumber == strategy)
+        parseE164DigitPrefix(theString, &thePattern);
+    else
+        parseE164DigitPattern(theString, &thePattern);
+    numberOfGrams = e164DigitPatternGramsOf(&thePattern, grams);
+    /* Patterns without grams, such as "%", have to look at every number */
+    *searchMode = (numberOfGrams > 0) ? GIN_SEARCH_MODE_DEFAULT
+                                      : GIN_SEARCH_MODE_ALL;
+    PG_RETURN_POINTER(digitGramDatums(grams, numberOfGrams, nkeys));
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_digit_pattern_consistent);
+Datum
+e164_gin_digit_pattern_consistent(PG_FUNCTION_ARGS)
+{
+    bool * check = (bool *) PG_GETARG_POINTER(0);
+    int32  nkeys = PG_GETARG_INT32(3);
+    bool * recheck = (bool *) PG_GETARG_POINTER(5);
+    int    i;
+
+    *recheck = true;
+    for (i = 0; i < nkeys; i++)
+        if (!check[i])
+            PG_RETURN_BOOL(false);
+    PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(e164_gin_digit_pattern_triconsistent);
+Datum
+e164_gin_digit_pattern_triconsistent(PG_FUNCTION_ARGS)
+{
+    GinTernaryValue * check = (GinTernaryValue *) PG_GETARG_POINTER(0);
+    int32             nkeys = PG_GETARG_INT32(3);
+    int               i;
+
+    for (i = 0; i < nkeys; i++)
+        if (GIN_FALSE == check[i])
+            PG_RETURN_GIN_TERNARY_VALUE(GIN_FALSE);
+    PG_RETURN_GIN_TERNARY_VALUE(GIN_MAYBE);
+}
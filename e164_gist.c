@@ -0,0 +1,340 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: GiST operator class
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "access/gist.h"
+#include "access/stratnum.h"
+#include "fmgr.h"
+#include "e164_base.h"
+
+/*
+ * The GiST operator class follows btree_gist: leaf and internal keys alike
+ * are the [lower, upper] bounds of the numbers below them, and the btree
+ * strategies are answered exactly from the bounds.  Besides index scans
+ * over e164 columns, this provides the = and <> strategies needed by
+ * exclusion constraints combining e164 with other GiST-indexed columns,
+ * and a <-> distance ordering for nearest-number (KNN) searches.
+ */
+typedef struct E164GistKey
+{
+    E164 lower;
+    E164 upper;
+} E164GistKey;
+
+#define E164GistNotEqualStrategyNumber  6
+#define E164GistDistanceStrategyNumber  15
+
+typedef struct E164GistSortItem
+{
+    int          index;
+    E164GistKey *key;
+} E164GistSortItem;
+
+Datum e164_gist_key_in(PG_FUNCTION_ARGS);
+Datum e164_gist_key_out(PG_FUNCTION_ARGS);
+
+Datum e164_gist_consistent(PG_FUNCTION_ARGS);
+Datum e164_gist_union(PG_FUNCTION_ARGS);
+Datum e164_gist_compress(PG_FUNCTION_ARGS);
+Datum e164_gist_decompress(PG_FUNCTION_ARGS);
+Datum e164_gist_penalty(PG_FUNCTION_ARGS);
+Datum e164_gist_picksplit(PG_FUNCTION_ARGS);
+Datum e164_gist_same(PG_FUNCTION_ARGS);
+Datum e164_gist_distance(PG_FUNCTION_ARGS);
+Datum e164_gist_fetch(PG_FUNCTION_ARGS);
+
+static void extendGistKey(E164GistKey * aKey, const E164GistKey * anotherKey);
+static int compareGistSortItems(const void * a, const void * b);
+
+
+PG_FUNCTION_INFO_V1(e164_gist_key_in);
+Datum
+e164_gist_key_in(PG_FUNCTION_ARGS)
+{
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+             errmsg("cannot accept a value of type e164_gist_key")));
+    PG_RETURN_VOID(); /* keep compiler quiet */
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_key_out);
+Datum
+e164_gist_key_out(PG_FUNCTION_ARGS)
+{
+    E164GistKey * key = (E164GistKey *) PG_GETARG_POINTER(0);
+    char lower[E164MaximumStringLength + 1];
+    char upper[E164MaximumStringLength + 1];
+
+    (void) rawStringFromE164(lower, sizeof(lower), key->lower);
+    (void) rawStringFromE164(upper, sizeof(upper), key->upper);
+    PG_RETURN_CSTRING(psprintf("[%s,%s]", lower, upper));
+}
+
+static void
+extendGistKey(E164GistKey * aKey, const E164GistKey * anotherKey)
+{
+    if (e164Comparison(anotherKey->lower, aKey->lower) < 0)
+        aKey->lower = anotherKey->lower;
+    if (e164Comparison(anotherKey->upper, aKey->upper) > 0)
+        aKey->upper = anotherKey->upper;
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_consistent);
+Datum
+e164_gist_consistent(PG_FUNCTION_ARGS)
+{
+    GISTENTRY *     entry = (GISTENTRY *) PG_GETARG_POINTER(0);
+    E164            query = PG_GETARG_E164(1);
+    StrategyNumber  strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+    bool *          recheck = (bool *) PG_GETARG_POINTER(4);
+    E164GistKey *   key = (E164GistKey *) DatumGetPointer(entry->key);
+    bool            result;
+
+    *recheck = false;
+
+    switch (strategy)
+    {
+        case BTLessStrategyNumber:
+            result = e164Comparison(key->lower, query) < 0;
+            break;
+        case BTLessEqualStrategyNumber:
+            result = e164Comparison(key->lower, query) <= 0;
+            break;
+        case BTEqualStrategyNumber:
+            result = (e164Comparison(key->lower, query) <= 0 &&
+                      e164Comparison(query, key->upper) <= 0);
+            break;
+        case BTGreaterEqualStrategyNumber:
+            result = e164Comparison(key->upper, query) >= 0;
+            break;
+        case BTGreaterStrategyNumber:
+            result = e164Comparison(key->upper, query) > 0;
+            break;
+        case E164GistNotEqualStrategyNumber:
+            result = !(e164Comparison(key->lower, query) == 0 &&
+                       e164Comparison(key->upper, query) == 0);
+            break;
+        default:
+            elog(ERROR, "unrecognized e164 GiST strategy number: %d", strategy);
+            result = false; /* keep compiler quiet */
+    }
+
+    PG_RETURN_BOOL(result);
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_union);
+Datum
+e164_gist_union(PG_FUNCTION_ARGS)
+{
+    GistEntryVector * entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+    int *             size = (int *) PG_GETARG_POINTER(1);
+    E164GistKey *     result = palloc(sizeof(E164GistKey));
+    int               i;
+
+    *result = *((E164GistKey *) DatumGetPointer(entryvec->vector[0].key));
+    for (i = 1; i < entryvec->n; ++i)
+        extendGistKey(result,
+                      (E164GistKey *) DatumGetPointer(entryvec->vector[i].key));
+
+    *size = sizeof(E164GistKey);
+    PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_compress);
+Datum
+e164_gist_compress(PG_FUNCTION_ARGS)
+{
+    GISTENTRY * entry = (GISTENTRY *) PG_GETARG_POINTER(0);
+    GISTENTRY * result = entry;
+
+    if (entry->leafkey)
+    {
+        E164GistKey * key = palloc(sizeof(E164GistKey));
+
+        key->lower = key->upper = DatumGetE164P(entry->key);
+        result = palloc(sizeof(GISTENTRY));
+        gistentryinit(*result, PointerGetDatum(key),
+                      entry->rel, entry->page, entry->offset, false);
+    }
+    PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_decompress);
+Datum
+e164_gist_decompress(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_fetch);
+Datum
+e164_gist_fetch(PG_FUNCTION_ARGS)
+{
+    GISTENTRY *   entry = (GISTENTRY *) PG_GETARG_POINTER(0);
+    E164GistKey * key = (E164GistKey *) DatumGetPointer(entry->key);
+    GISTENTRY *   result = palloc(sizeof(GISTENTRY));
+
+    gistentryinit(*result, E164PGetDatum(key->lower),
+                  entry->rel, entry->page, entry->offset, false);
+    PG_RETURN_POINTER(result);
+}
+
+/*
+ * The penalty is the growth of the key range, in numbers, needed to take
+ * in the new key.
+ */
+PG_FUNCTION_INFO_V1(e164_gist_penalty);
+Datum
+e164_gist_penalty(PG_FUNCTION_ARGS)
+{
+    GISTENTRY *   originalEntry = (GISTENTRY *) PG_GETARG_POINTER(0);
+    GISTENTRY *   newEntry = (GISTENTRY *) PG_GETARG_POINTER(1);
+    float *       penalty = (float *) PG_GETARG_POINTER(2);
+    E164GistKey * originalKey = (E164GistKey *) DatumGetPointer(originalEntry->key);
+    E164GistKey * newKey = (E164GistKey *) DatumGetPointer(newEntry->key);
+    E164GistKey   extendedKey = *originalKey;
+
+    extendGistKey(&extendedKey, newKey);
+    *penalty = (float) (e164Distance(extendedKey.lower, extendedKey.upper) -
+                        e164Distance(originalKey->lower, originalKey->upper));
+    PG_RETURN_POINTER(penalty);
+}
+
+static int
+compareGistSortItems(const void * a, const void * b)
+{
+    int64 comparison = e164Comparison(((const E164GistSortItem *) a)->key->lower,
+                                      ((const E164GistSortItem *) b)->key->lower);
+    return (comparison < 0) ? -1 : ((comparison > 0) ? 1 : 0);
+}
+
+/*
+ * e164_gist_picksplit sorts the entries by their lower bounds and puts the
+ * first half on the left and the rest on the right, as btree_gist does.
+ */
+PG_FUNCTION_INFO_V1(e164_gist_picksplit);
+Datum
+e164_gist_picksplit(PG_FUNCTION_ARGS)
+{
+    GistEntryVector *  entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+    GIST_SPLITVEC *    splitvec = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
+    OffsetNumber       maxoff = entryvec->n - 1;
+    int                numberOfItems = maxoff - FirstOffsetNumber + 1;
+    E164GistSortItem * items = palloc(numberOfItems * sizeof(E164GistSortItem));
+    E164GistKey *      leftKey = NULL;
+    E164GistKey *      rightKey = NULL;
+    int                i;
+
+    for (i = 0; i < numberOfItems; ++i)
+    {
+        items[i].index = FirstOffsetNumber + i;
+        items[i].key = (E164GistKey *)
+            DatumGetPointer(entryvec->vector[FirstOffsetNumber + i].key);
+    }
+    qsort(items, numberOfItems, sizeof(E164GistSortItem), compareGistSortItems);
+
+    splitvec->spl_left = palloc(numberOfItems * sizeof(OffsetNumber));
+    splitvec->spl_right = palloc(numberOfItems * sizeof(OffsetNumber));
+    splitvec->spl_nleft = 0;
+    splitvec->spl_nright = 0;
+
+    for (i = 0; i < numberOfItems; ++i)
+    {
+        if (i < numberOfItems / 2)
+        {
+            splitvec->spl_left[splitvec->spl_nleft++] = items[i].index;
+            if (!leftKey)
+            {
+                leftKey = palloc(sizeof(E164GistKey));
+                *leftKey = *items[i].key;
+            }
+            else
+                extendGistKey(leftKey, items[i].key);
+        }
+        else
+        {
+            splitvec->spl_right[splitvec->spl_nright++] = items[i].index;
+            if (!rightKey)
+            {
+                rightKey = palloc(sizeof(E164GistKey));
+                *rightKey = *items[i].key;
+            }
+            else
+                extendGistKey(rightKey, items[i].key);
+        }
+    }
+
+    splitvec->spl_ldatum = PointerGetDatum(leftKey);
+    splitvec->spl_rdatum = PointerGetDatum(rightKey);
+    PG_RETURN_POINTER(splitvec);
+}
+
+PG_FUNCTION_INFO_V1(e164_gist_same);
+Datum
+e164_gist_same(PG_FUNCTION_ARGS)
+{
+    E164GistKey * firstKey = (E164GistKey *) PG_GETARG_POINTER(0);
+    E164GistKey * secondKey = (E164GistKey *) PG_GETARG_POINTER(1);
+    bool *        result = (bool *) PG_GETARG_POINTER(2);
+
+    *result = (e164Comparison(firstKey->lower, secondKey->lower) == 0 &&
+               e164Comparison(firstKey->upper, secondKey->upper) == 0);
+    PG_RETURN_POINTER(result);
+}
+
+/*
+ * e164_gist_distance returns the distance from the query to the nearest
+ * number the key may cover, which is exact for leaf keys.
+ */
+PG_FUNCTION_INFO_V1(e164_gist_distance);
+Datum
+e164_gist_distance(PG_FUNCTION_ARGS)
+{
+    GISTENTRY *     entry = (GISTENTRY *) PG_GETARG_POINTER(0);
+    E164            query = PG_GETARG_E164(1);
+    StrategyNumber  strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+    bool *          recheck = (bool *) PG_GETARG_POINTER(4);
+    E164GistKey *   key = (E164GistKey *) DatumGetPointer(entry->key);
+    uint64          distance = 0;
+
+    if (strategy != E164GistDistanceStrategyNumber)
+        elog(ERROR, "unrecognized e164 GiST strategy number: %d", strategy);
+
+    *recheck = false;
+
+    if (e164Comparison(query, key->lower) < 0)
+        distance = e164Distance(query, key->lower);
+    else if (e164Comparison(query, key->upper) > 0)
+        distance = e164Distance(query, key->upper);
+
+    PG_RETURN_FLOAT8((float8) distance);
+}
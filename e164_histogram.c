@@ -0,0 +1,201 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Country code histograms
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
+#include "e164_base.h"
+
+/*
+ * e164_cc_histogram(n) counts numbers per country code.  Its state is a
+ * flat array of counters indexed by the country code cached in each
+ * number, so a row costs an increment and partial states are merged by
+ * adding the arrays, with no hashing or text conversion.  The result is
+ * an array of e164_cc_count (cc, count), by country code, of the country
+ * codes counted at least once.
+ */
+typedef struct E164CCHistogram
+{
+    int32 vl_len_;
+    int64 counts[E164_MAX_COUNTRY_CODE_VALUE + 1];
+} E164CCHistogram;
+
+Datum e164_cc_histogram_transfn(PG_FUNCTION_ARGS);
+Datum e164_cc_histogram_finalfn(PG_FUNCTION_ARGS);
+Datum e164_cc_histogram_combinefn(PG_FUNCTION_ARGS);
+Datum e164_cc_histogram_serialfn(PG_FUNCTION_ARGS);
+Datum e164_cc_histogram_deserialfn(PG_FUNCTION_ARGS);
+
+static E164CCHistogram * newCCHistogram(MemoryContext aContext);
+static E164CCHistogram * copyCCHistogram(MemoryContext aContext,
+                                         const E164CCHistogram * aHistogram);
+
+
+static E164CCHistogram *
+newCCHistogram(MemoryContext aContext)
+{
+    E164CCHistogram * theHistogram =
+        MemoryContextAllocZero(aContext, sizeof(E164CCHistogram));
+
+    SET_VARSIZE(theHistogram, sizeof(E164CCHistogram));
+    return theHistogram;
+}
+
+static E164CCHistogram *
+copyCCHistogram(MemoryContext aContext, const E164CCHistogram * aHistogram)
+{
+    E164CCHistogram * theCopy = MemoryContextAlloc(aContext,
+                                                   sizeof(E164CCHistogram));
+
+    memcpy(theCopy, aHistogram, sizeof(E164CCHistogram));
+    return theCopy;
+}
+
+PG_FUNCTION_INFO_V1(e164_cc_histogram_transfn);
+Datum
+e164_cc_histogram_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164CCHistogram * theHistogram;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_cc_histogram_transfn called in non-aggregate context");
+
+    if (PG_ARGISNULL(0))
+        theHistogram = newCCHistogram(aggContext);
+    else
+        theHistogram = (E164CCHistogram *) PG_GETARG_POINTER(0);
+
+    if (!PG_ARGISNULL(1))
+        theHistogram->counts[countryCodeOfE164(PG_GETARG_E164(1))]++;
+    PG_RETURN_POINTER(theHistogram);
+}
+
+PG_FUNCTION_INFO_V1(e164_cc_histogram_finalfn);
+Datum
+e164_cc_histogram_finalfn(PG_FUNCTION_ARGS)
+{
+    E164CCHistogram * theHistogram;
+    Oid theEntryType;
+    TupleDesc theDescriptor;
+    int16 theEntryLength;
+    bool theEntryByValue;
+    char theEntryAlignment;
+    Datum * theEntries;
+    int numberOfEntries = 0;
+    int theCountryCode;
+
+    if (PG_ARGISNULL(0))
+        PG_RETURN_NULL();
+    theHistogram = (E164CCHistogram *) PG_GETARG_POINTER(0);
+
+    theEntryType = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+    if (!OidIsValid(theEntryType))
+        elog(ERROR, "could not determine the e164_cc_count type");
+    theDescriptor = lookup_rowtype_tupdesc(theEntryType, -1);
+    get_typlenbyvalalign(theEntryType, &theEntryLength, &theEntryByValue,
+                         &theEntryAlignment);
+
+    theEntries = palloc((E164_MAX_COUNTRY_CODE_VALUE + 1) * sizeof(Datum));
+    for (theCountryCode = 0;
+         theCountryCode <= E164_MAX_COUNTRY_CODE_VALUE;
+         theCountryCode++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+
+        if (0 == theHistogram->counts[theCountryCode])
+            continue;
+        values[0] = Int32GetDatum(theCountryCode);
+        values[1] = Int64GetDatum(theHistogram->counts[theCountryCode]);
+        theEntries[numberOfEntries++] =
+            HeapTupleGetDatum(heap_form_tuple(theDescriptor, values, nulls));
+    }
+    ReleaseTupleDesc(theDescriptor);
+
+    PG_RETURN_ARRAYTYPE_P(construct_array(theEntries, numberOfEntries,
+                                          theEntryType, theEntryLength,
+                                          theEntryByValue, theEntryAlignment));
+}
+
+PG_FUNCTION_INFO_V1(e164_cc_histogram_combinefn);
+Datum
+e164_cc_histogram_combinefn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164CCHistogram * theHistogram;
+    E164CCHistogram * theOtherHistogram;
+    int i;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_cc_histogram_combinefn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    theOtherHistogram = (E164CCHistogram *) PG_GETARG_POINTER(1);
+    if (PG_ARGISNULL(0))
+        PG_RETURN_POINTER(copyCCHistogram(aggContext, theOtherHistogram));
+
+    theHistogram = (E164CCHistogram *) PG_GETARG_POINTER(0);
+    for (i = 0; i <= E164_MAX_COUNTRY_CODE_VALUE; i++)
+        theHistogram->counts[i] += theOtherHistogram->counts[i];
+    PG_RETURN_POINTER(theHistogram);
+}
+
+PG_FUNCTION_INFO_V1(e164_cc_histogram_serialfn);
+Datum
+e164_cc_histogram_serialfn(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BYTEA_P(copyCCHistogram(CurrentMemoryContext,
+                                      (E164CCHistogram *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_cc_histogram_deserialfn);
+Datum
+e164_cc_histogram_deserialfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_cc_histogram_deserialfn called in non-aggregate context");
+
+    PG_RETURN_POINTER(copyCCHistogram(aggContext,
+                                      (E164CCHistogram *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0))));
+}
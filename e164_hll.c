@@ -0,0 +1,359 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: HyperLogLog aggregates
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include <math.h>
+#include "fmgr.h"
+#include "port/pg_bitutils.h"
+#include "e164_base.h"
+
+/*
+ * HyperLogLog sketches estimate the number of distinct numbers in a set
+ * in fixed memory: 2^p one-byte registers, each holding the largest rank
+ * (position of the leftmost one bit) seen among the hashes whose first p
+ * bits select it.  The standard error is about 1.04 / sqrt(2^p), under 1%
+ * for the default precision of 14, which takes 16 kB.  Sketches of the
+ * same precision are merged by taking the larger register values, which
+ * makes them suitable for partial and parallel aggregation and for
+ * rolling up, e.g., hourly sketches into daily counts.
+ *
+ * The format is a version byte and the precision, followed by the
+ * registers, and is the same on every platform.
+ */
+#define E164HLLVersion           1
+#define E164HLLMinimumPrecision  4
+#define E164HLLMaximumPrecision  18
+#define E164HLLDefaultPrecision  14
+
+typedef struct E164HLLSketch
+{
+    int32 vl_len_;
+    uint8 version;
+    uint8 precision;
+    uint8 registers[FLEXIBLE_ARRAY_MEMBER];
+} E164HLLSketch;
+
+#define E164HLLSketchSize(precision) \
+    (offsetof(E164HLLSketch, registers) + ((Size) 1 << (precision)))
+
+Datum e164_hll_transfn(PG_FUNCTION_ARGS);
+Datum e164_hll_finalfn(PG_FUNCTION_ARGS);
+Datum e164_hll_sketch_finalfn(PG_FUNCTION_ARGS);
+Datum e164_hll_combinefn(PG_FUNCTION_ARGS);
+Datum e164_hll_serialfn(PG_FUNCTION_ARGS);
+Datum e164_hll_deserialfn(PG_FUNCTION_ARGS);
+Datum e164_hll_union_transfn(PG_FUNCTION_ARGS);
+Datum e164_hll_cardinality(PG_FUNCTION_ARGS);
+Datum e164_hll_union(PG_FUNCTION_ARGS);
+
+static E164HLLSketch * newHLLSketch(MemoryContext aContext, int32 precision);
+static E164HLLSketch * copyHLLSketch(MemoryContext aContext,
+                                     const E164HLLSketch * aSketch);
+static const E164HLLSketch * checkHLLSketch(const struct varlena * aValue);
+static void hllSketchUnion(E164HLLSketch * aSketch,
+                           const E164HLLSketch * anotherSketch);
+static void hllSketchAdd(E164HLLSketch * aSketch, E164 aNumber);
+static int64 hllSketchCardinality(const E164HLLSketch * aSketch);
+
+
+static E164HLLSketch *
+newHLLSketch(MemoryContext aContext, int32 precision)
+{
+    E164HLLSketch * theSketch;
+
+    if (precision < E164HLLMinimumPrecision ||
+        precision > E164HLLMaximumPrecision)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("HyperLogLog precision must be between %d and %d",
+                        E164HLLMinimumPrecision, E164HLLMaximumPrecision)));
+
+    theSketch = MemoryContextAllocZero(aContext, E164HLLSketchSize(precision));
+    SET_VARSIZE(theSketch, E164HLLSketchSize(precision));
+    theSketch->version = E164HLLVersion;
+    theSketch->precision = precision;
+    return theSketch;
+}
+
+static E164HLLSketch *
+copyHLLSketch(MemoryContext aContext, const E164HLLSketch * aSketch)
+{
+    E164HLLSketch * theCopy = MemoryContextAlloc(aContext, VARSIZE(aSketch));
+
+    memcpy(theCopy, aSketch, VARSIZE(aSketch));
+    return theCopy;
+}
+
+static const E164HLLSketch *
+checkHLLSketch(const struct varlena * aValue)
+{
+    const E164HLLSketch * theSketch = (const E164HLLSketch *) aValue;
+
+    if (VARSIZE(aValue) < offsetof(E164HLLSketch, registers) ||
+        E164HLLVersion != theSketch->version ||
+        theSketch->precision < E164HLLMinimumPrecision ||
+        theSketch->precision > E164HLLMaximumPrecision ||
+        VARSIZE(aValue) != E164HLLSketchSize(theSketch->precision))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid E164 HyperLogLog sketch")));
+    return theSketch;
+}
+
+static void
+hllSketchUnion(E164HLLSketch * aSketch, const E164HLLSketch * anotherSketch)
+{
+    Size numberOfRegisters = (Size) 1 << aSketch->precision;
+    Size i;
+
+    if (aSketch->precision != anotherSketch->precision)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("cannot combine HyperLogLog sketches of different precisions"),
+                 errdetail("The precisions are %d and %d.",
+                           aSketch->precision, anotherSketch->precision)));
+
+    for (i = 0; i < numberOfRegisters; i++)
+        if (anotherSketch->registers[i] > aSketch->registers[i])
+            aSketch->registers[i] = anotherSketch->registers[i];
+}
+
+static void
+hllSketchAdd(E164HLLSketch * aSketch, E164 aNumber)
+{
+    uint64 theHash = e164Hash(aNumber);
+    uint32 theRegister = theHash >> (64 - aSketch->precision);
+    uint64 theRest = theHash << aSketch->precision;
+    uint8 theRank = (0 == theRest)
+        ? 64 - aSketch->precision + 1
+        : 63 - pg_leftmost_one_pos64(theRest) + 1;
+
+    if (theRank > aSketch->registers[theRegister])
+        aSketch->registers[theRegister] = theRank;
+}
+
+/*
+ * hllSketchCardinality returns the raw HyperLogLog estimate, or the linear
+ * counting one for small cardinalities, for which it is more accurate.  As
+ * the hashes have 64 bits, no large range correction is needed.
+ */
+static int64
+hllSketchCardinality(const E164HLLSketch * aSketch)
+{
+    int numberOfRegisters = 1 << aSketch->precision;
+    double alpha;
+    double sum = 0.0;
+    int numberOfZeros = 0;
+    double estimate;
+    int i;
+
+    switch (numberOfRegisters)
+    {
+        case 16:
+            alpha = 0.673;
+            break;
+        case 32:
+            alpha = 0.697;
+            break;
+        case 64:
+            alpha = 0.709;
+            break;
+        default:
+            alpha = 0.7213 / (1.0 + 1.079 / numberOfRegisters);
+            break;
+    }
+
+    for (i = 0; i < numberOfRegisters; i++)
+    {
+        sum += ldexp(1.0, -aSketch->registers[i]);
+        if (0 == aSketch->registers[i])
+            numberOfZeros++;
+    }
+    estimate = alpha * numberOfRegisters * numberOfRegisters / sum;
+    if (estimate <= 2.5 * numberOfRegisters && numberOfZeros > 0)
+        estimate = numberOfRegisters *
+            log((double) numberOfRegisters / numberOfZeros);
+    return (int64) (estimate + 0.5);
+}
+
+/*
+ * e164_hll_transfn is the transition function of both e164_hll and
+ * e164_hll_sketch, with and without a precision.
+ */
+PG_FUNCTION_INFO_V1(e164_hll_transfn);
+Datum
+e164_hll_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164HLLSketch * theSketch;
+    int32 precision = E164HLLDefaultPrecision;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_hll_transfn called in non-aggregate context");
+    if (PG_NARGS() > 2)
+    {
+        if (PG_ARGISNULL(2))
+            ereport(ERROR,
+                    (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                     errmsg("HyperLogLog precision must not be null")));
+        precision = PG_GETARG_INT32(2);
+    }
+
+    if (PG_ARGISNULL(0))
+        theSketch = newHLLSketch(aggContext, precision);
+    else
+    {
+        theSketch = (E164HLLSketch *) PG_GETARG_POINTER(0);
+        if (theSketch->precision != precision)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("HyperLogLog precision must be the same for every row")));
+    }
+
+    if (!PG_ARGISNULL(1))
+        hllSketchAdd(theSketch, PG_GETARG_E164(1));
+    PG_RETURN_POINTER(theSketch);
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_finalfn);
+Datum
+e164_hll_finalfn(PG_FUNCTION_ARGS)
+{
+    if (PG_ARGISNULL(0))
+        PG_RETURN_INT64(0);
+    PG_RETURN_INT64(hllSketchCardinality((E164HLLSketch *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_sketch_finalfn);
+Datum
+e164_hll_sketch_finalfn(PG_FUNCTION_ARGS)
+{
+    if (PG_ARGISNULL(0))
+        PG_RETURN_NULL();
+    PG_RETURN_BYTEA_P(copyHLLSketch(CurrentMemoryContext,
+                                    (E164HLLSketch *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_combinefn);
+Datum
+e164_hll_combinefn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164HLLSketch * theSketch;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_hll_combinefn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    if (PG_ARGISNULL(0))
+        PG_RETURN_POINTER(copyHLLSketch(aggContext,
+                                        (E164HLLSketch *) PG_GETARG_POINTER(1)));
+
+    theSketch = (E164HLLSketch *) PG_GETARG_POINTER(0);
+    hllSketchUnion(theSketch, (E164HLLSketch *) PG_GETARG_POINTER(1));
+    PG_RETURN_POINTER(theSketch);
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_serialfn);
+Datum
+e164_hll_serialfn(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BYTEA_P(copyHLLSketch(CurrentMemoryContext,
+                                    (E164HLLSketch *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_deserialfn);
+Datum
+e164_hll_deserialfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_hll_deserialfn called in non-aggregate context");
+
+    PG_RETURN_POINTER(copyHLLSketch(aggContext,
+                                    checkHLLSketch(PG_DETOAST_DATUM(PG_GETARG_DATUM(0)))));
+}
+
+/*
+ * e164_hll_union_transfn is the transition function of e164_hll_union_agg,
+ * which merges sketches.
+ */
+PG_FUNCTION_INFO_V1(e164_hll_union_transfn);
+Datum
+e164_hll_union_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    const E164HLLSketch * theOtherSketch;
+    E164HLLSketch * theSketch;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_hll_union_transfn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    theOtherSketch = checkHLLSketch(PG_DETOAST_DATUM(PG_GETARG_DATUM(1)));
+    if (PG_ARGISNULL(0))
+        PG_RETURN_POINTER(copyHLLSketch(aggContext, theOtherSketch));
+
+    theSketch = (E164HLLSketch *) PG_GETARG_POINTER(0);
+    hllSketchUnion(theSketch, theOtherSketch);
+    PG_RETURN_POINTER(theSketch);
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_cardinality);
+Datum
+e164_hll_cardinality(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_INT64(hllSketchCardinality(checkHLLSketch(PG_DETOAST_DATUM(PG_GETARG_DATUM(0)))));
+}
+
+PG_FUNCTION_INFO_V1(e164_hll_union);
+Datum
+e164_hll_union(PG_FUNCTION_ARGS)
+{
+    E164HLLSketch * theUnion =
+        copyHLLSketch(CurrentMemoryContext,
+                      checkHLLSketch(PG_DETOAST_DATUM(PG_GETARG_DATUM(0))));
+
+    hllSketchUnion(theUnion, checkHLLSketch(PG_DETOAST_DATUM(PG_GETARG_DATUM(1))));
+    PG_RETURN_BYTEA_P(theUnion);
+}
@@ -0,0 +1,806 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Prefix metadata lookups
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/stat.h>
+#include "postgres.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "port/pg_bitutils.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "e164_prefix.h"
+
+/*
+ * The prefix data is kept in shared memory as a radix-10 trie, so that a
+ * lookup is a walk over at most E164MaximumNumberOfDigits nodes.
+ *
+ * Each node carries a bitmap of its existing children, and the children of
+ * a node are stored contiguously, so a node is 12 bytes regardless of its
+ * fan-out and the child for a digit d is found at
+ *
+ *     firstChild + popcount(childMap & ((1 << d) - 1))
+ *
+ * Two snapshot slots are reserved.  A reload builds the new trie in the
+ * inactive slot and then flips the active slot index, so readers never
+ * block.  Each slot is guarded by a change counter used as a sequence lock:
+ * a reader which finds the counter changed after its walk (because the slot
+ * was reused by a second reload meanwhile) simply retries.
+ */
+typedef struct E164PrefixNode
+{
+    uint16 childMap;
+    int32  firstChild;
+    int32  entry;
+} E164PrefixNode;
+
+#define E164PrefixNoEntry (-1)
+
+typedef struct E164PrefixEntry
+{
+    uint32 attributes[E164NumberOfPrefixAttributes];
+} E164PrefixEntry;
+
+#define E164PrefixAttributeUndefined PG_UINT32_MAX
+
+typedef struct E164PrefixSnapshot
+{
+    pg_atomic_uint64 changeCount;
+    uint64 version;
+    uint32 numberOfNodes;
+    uint32 numberOfEntries;
+    uint32 stringsSize;
+    /* The identity of the loaded file, to skip redundant reloads */
+    char   path[MAXPGPATH];
+    time_t modificationTime;
+    off_t  fileSize;
+    /* Nodes, entries and NUL-terminated attribute strings follow */
+} E164PrefixSnapshot;
+
+#define E164PrefixNoSnapshot PG_UINT32_MAX
+
+typedef struct E164PrefixSharedState
+{
+    LWLock * lock;
+    pg_atomic_uint32 activeSnapshot;
+    uint64 lastVersion;
+    Size   snapshotSize;
+} E164PrefixSharedState;
+
+/*
+ * Prefix data file entries, as collected by the loader before the trie is
+ * laid out.
+ */
+typedef struct E164PrefixBuildEntry
+{
+    char   digits[E164MaximumNumberOfDigits + 1];
+    int    length;
+    int    lineNumber;
+    uint32 attributes[E164NumberOfPrefixAttributes];
+} E164PrefixBuildEntry;
+
+typedef struct E164PrefixBuild
+{
+    const char * path;
+    E164PrefixBuildEntry * entries;
+    int    numberOfEntries;
+    int    allocatedEntries;
+    HTAB * stringOffsets;
+    StringInfoData strings;
+} E164PrefixBuild;
+
+typedef struct E164PrefixStringOffset
+{
+    char   string[E164PrefixAttributeMaximumLength + 1];
+    uint32 offset;
+} E164PrefixStringOffset;
+
+#define E164PrefixMaximumLineLength 1024
+
+static const char * prefixAttributeNames[E164NumberOfPrefixAttributes] = {
+    "carrier",
+    "region",
+    "timezone"
+};
+
+char * e164PrefixFile = NULL;
+int e164PrefixMemory = 0;
+
+static E164PrefixSharedState * prefixState = NULL;
+static bool prefixReloadPending = true;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prevShmemRequestHook = NULL;
+#endif
+static shmem_startup_hook_type prevShmemStartupHook = NULL;
+
+static Size prefixSnapshotSize(void);
+static Size prefixShmemSize(void);
+#if PG_VERSION_NUM >= 150000
+static void prefixShmemRequest(void);
+#endif
+static void prefixShmemStartup(void);
+
+static E164PrefixSnapshot * prefixSnapshot(uint32 slot);
+static E164PrefixNode * prefixNodesOf(const E164PrefixSnapshot * aSnapshot);
+static E164PrefixEntry * prefixEntriesOf(const E164PrefixSnapshot * aSnapshot);
+static char * prefixStringsOf(const E164PrefixSnapshot * aSnapshot);
+static Size prefixSnapshotDataSize(uint32 numberOfNodes,
+                                   uint32 numberOfEntries,
+                                   uint32 stringsSize);
+
+static void parsePrefixFile(E164PrefixBuild * aBuild);
+static void addPrefixEntry(E164PrefixBuild * aBuild, char ** fields,
+                           int numberOfFields, int lineNumber);
+static uint32 internPrefixAttribute(E164PrefixBuild * aBuild,
+                                    const char * aString, int lineNumber);
+static int comparePrefixBuildEntries(const void * a, const void * b);
+static uint32 countPrefixNodes(const E164PrefixBuildEntry * entries,
+                               int low, int high, int depth);
+static void layoutPrefixNodes(const E164PrefixBuildEntry * entries,
+                              int low, int high, int depth,
+                              E164PrefixNode * nodes, uint32 nodeIndex,
+                              uint32 * nextFreeNode);
+
+static bool walkPrefixSnapshot(const E164PrefixSnapshot * aSnapshot,
+                               const char * digits,
+                               E164PrefixAttribute anAttribute,
+                               char * aString, int stringLength);
+
+
+/*
+ * e164PrefixInit reserves the shared memory for the prefix snapshots.  It
+ * is a no-op unless the module is being loaded via shared_preload_libraries
+ * and e164.prefix_memory is set.
+ */
+void
+e164PrefixInit(void)
+{
+    if (!process_shared_preload_libraries_in_progress || e164PrefixMemory <= 0)
+        return;
+
+#if PG_VERSION_NUM >= 150000
+    prevShmemRequestHook = shmem_request_hook;
+    shmem_request_hook = prefixShmemRequest;
+#else
+    RequestAddinShmemSpace(prefixShmemSize());
+    RequestNamedLWLockTranche("e164_prefix", 1);
+#endif
+    prevShmemStartupHook = shmem_startup_hook;
+    shmem_startup_hook = prefixShmemStartup;
+}
+
+static Size
+prefixSnapshotSize(void)
+{
+    return MAXALIGN(mul_size((Size) e164PrefixMemory, 1024));
+}
+
+static Size
+prefixShmemSize(void)
+{
+    return add_size(MAXALIGN(sizeof(E164PrefixSharedState)),
+                    mul_size(2, prefixSnapshotSize()));
+}
+
+#if PG_VERSION_NUM >= 150000
+static void
+prefixShmemRequest(void)
+{
+    if (prevShmemRequestHook)
+        prevShmemRequestHook();
+
+    RequestAddinShmemSpace(prefixShmemSize());
+    RequestNamedLWLockTranche("e164_prefix", 1);
+}
+#endif
+
+static void
+prefixShmemStartup(void)
+{
+    bool found;
+
+    if (prevShmemStartupHook)
+        prevShmemStartupHook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+    prefixState = ShmemInitStruct("e164 prefix snapshots", prefixShmemSize(),
+                                  &found);
+    if (!found)
+    {
+        uint32 slot;
+
+        prefixState->lock = &(GetNamedLWLockTranche("e164_prefix"))->lock;
+        pg_atomic_init_u32(&prefixState->activeSnapshot, E164PrefixNoSnapshot);
+        prefixState->lastVersion = 0;
+        prefixState->snapshotSize = prefixSnapshotSize();
+        for (slot = 0; slot < 2; ++slot)
+            pg_atomic_init_u64(&prefixSnapshot(slot)->changeCount, 0);
+    }
+    LWLockRelease(AddinShmemInitLock);
+}
+
+static E164PrefixSnapshot *
+prefixSnapshot(uint32 slot)
+{
+    return (E164PrefixSnapshot *) (((char *) prefixState) +
+                                   MAXALIGN(sizeof(E164PrefixSharedState)) +
+                                   slot * prefixState->snapshotSize);
+}
+
+static E164PrefixNode *
+prefixNodesOf(const E164PrefixSnapshot * aSnapshot)
+{
+    return (E164PrefixNode *) (((char *) aSnapshot) +
+                               MAXALIGN(sizeof(E164PrefixSnapshot)));
+}
+
+static E164PrefixEntry *
+prefixEntriesOf(const E164PrefixSnapshot * aSnapshot)
+{
+    return (E164PrefixEntry *) (prefixNodesOf(aSnapshot) +
+                                aSnapshot->numberOfNodes);
+}
+
+static char *
+prefixStringsOf(const E164PrefixSnapshot * aSnapshot)
+{
+    return (char *) (prefixEntriesOf(aSnapshot) + aSnapshot->numberOfEntries);
+}
+
+static Size
+prefixSnapshotDataSize(uint32 numberOfNodes, uint32 numberOfEntries,
+                       uint32 stringsSize)
+{
+    return MAXALIGN(sizeof(E164PrefixSnapshot)) +
+        (Size) numberOfNodes * sizeof(E164PrefixNode) +
+        (Size) numberOfEntries * sizeof(E164PrefixEntry) +
+        (Size) stringsSize;
+}
+
+/*
+ * e164PrefixRequestReload is called on configuration reload (SIGHUP): the
+ * next lookup in this backend checks whether the prefix file has changed.
+ */
+void
+e164PrefixRequestReload(void)
+{
+    prefixReloadPending = true;
+}
+
+/*
+ * e164PrefixReload loads the prefix file into the inactive snapshot slot
+ * and makes it the active one, returning the version of the active
+ * snapshot.  Unless force is set, the file is not reloaded when its path,
+ * size and modification time match those of the active snapshot, so that
+ * only the first backend to notice a configuration reload does the work.
+ */
+uint64
+e164PrefixReload(bool force)
+{
+    MemoryContext loadContext;
+    MemoryContext oldContext;
+    E164PrefixBuild build;
+    E164PrefixSnapshot * active = NULL;
+    E164PrefixSnapshot * target;
+    E164PrefixEntry * entries;
+    uint32 activeSlot;
+    uint32 targetSlot;
+    uint32 numberOfNodes;
+    uint32 nextFreeNode = 1;
+    struct stat fileStat;
+    uint64 version;
+    int i;
+
+    if (!prefixState)
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                 errmsg("e164 prefix lookups are not enabled"),
+                 errhint("Add e164 to shared_preload_libraries and set e164.prefix_memory.")));
+
+    if (!e164PrefixFile || !*e164PrefixFile)
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                 errmsg("e164.prefix_file is not set")));
+
+    LWLockAcquire(prefixState->lock, LW_EXCLUSIVE);
+    prefixReloadPending = false;
+
+    if (stat(e164PrefixFile, &fileStat) != 0)
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not stat e164 prefix file \"%s\": %m",
+                        e164PrefixFile)));
+
+    activeSlot = pg_atomic_read_u32(&prefixState->activeSnapshot);
+    if (activeSlot != E164PrefixNoSnapshot)
+    {
+        active = prefixSnapshot(activeSlot);
+        if (!force &&
+            strcmp(active->path, e164PrefixFile) == 0 &&
+            active->modificationTime == fileStat.st_mtime &&
+            active->fileSize == fileStat.st_size)
+        {
+            version = active->version;
+            LWLockRelease(prefixState->lock);
+            return version;
+        }
+    }
+
+    /*
+     * Everything which may fail is done before the target slot is touched,
+     * so an error never leaves a slot half-written.
+     */
+    loadContext = AllocSetContextCreate(CurrentMemoryContext,
+                                        "e164 prefix load",
+                                        ALLOCSET_DEFAULT_SIZES);
+    oldContext = MemoryContextSwitchTo(loadContext);
+
+    memset(&build, 0, sizeof(build));
+    build.path = e164PrefixFile;
+    parsePrefixFile(&build);
+
+    if (build.numberOfEntries > 1)
+        qsort(build.entries, build.numberOfEntries,
+              sizeof(E164PrefixBuildEntry), comparePrefixBuildEntries);
+
+    for (i = 1; i < build.numberOfEntries; ++i)
+        if (strcmp(build.entries[i - 1].digits, build.entries[i].digits) == 0)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("duplicate prefix \"%s\" at lines %d and %d of e164 prefix file \"%s\"",
+                            build.entries[i].digits,
+                            build.entries[i - 1].lineNumber,
+                            build.entries[i].lineNumber, build.path)));
+
+    numberOfNodes = countPrefixNodes(build.entries, 0, build.numberOfEntries, 0);
+
+    if (prefixSnapshotDataSize(numberOfNodes, build.numberOfEntries,
+                               build.strings.len) > prefixState->snapshotSize)
+        ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("e164 prefix file \"%s\" does not fit in e164.prefix_memory",
+                        build.path),
+                 errdetail("The prefix data requires %zu kB.",
+                           prefixSnapshotDataSize(numberOfNodes,
+                                                  build.numberOfEntries,
+                                                  build.strings.len) / 1024 + 1)));
+
+    targetSlot = (activeSlot == 0) ? 1 : 0;
+    target = prefixSnapshot(targetSlot);
+
+    pg_atomic_fetch_add_u64(&target->changeCount, 1);
+    pg_write_barrier();
+
+    target->version = ++prefixState->lastVersion;
+    target->numberOfNodes = numberOfNodes;
+    target->numberOfEntries = build.numberOfEntries;
+    target->stringsSize = build.strings.len;
+    strlcpy(target->path, build.path, MAXPGPATH);
+    target->modificationTime = fileStat.st_mtime;
+    target->fileSize = fileStat.st_size;
+
+    layoutPrefixNodes(build.entries, 0, build.numberOfEntries, 0,
+                      prefixNodesOf(target), 0, &nextFreeNode);
+    Assert(nextFreeNode == numberOfNodes);
+
+    entries = prefixEntriesOf(target);
+    for (i = 0; i < build.numberOfEntries; ++i)
+        memcpy(entries[i].attributes, build.entries[i].attributes,
+               sizeof(entries[i].attributes));
+    memcpy(prefixStringsOf(target), build.strings.data, build.strings.len);
+
+    pg_write_barrier();
+    pg_atomic_fetch_add_u64(&target->changeCount, 1);
+    pg_atomic_write_u32(&prefixState->activeSnapshot, targetSlot);
+
+    version = target->version;
+    LWLockRelease(prefixState->lock);
+
+    MemoryContextSwitchTo(oldContext);
+    MemoryContextDelete(loadContext);
+
+    elog(DEBUG1, "loaded %d prefixes from e164 prefix file \"%s\" (version " UINT64_FORMAT ")",
+         build.numberOfEntries, build.path, version);
+
+    return version;
+}
+
+/*
+ * The prefix data file consists of lines of tab-separated fields:
+ *
+ * +prefix	carrier	region	timezone
+ *
+ * The prefix is one or more digits, optionally preceded by the "+" sign.
+ * Trailing fields may be omitted, and empty fields leave the attribute
+ * undefined for the prefix, so that a lookup falls back to the longest
+ * shorter prefix which defines it.  Blank lines and lines starting with
+ * "#" are ignored.
+ */
+static void
+parsePrefixFile(E164PrefixBuild * aBuild)
+{
+    HASHCTL hashInfo;
+    int hashFlags = HASH_ELEM | HASH_CONTEXT;
+    FILE * file;
+    char line[E164PrefixMaximumLineLength + 1];
+    int lineNumber = 0;
+
+    memset(&hashInfo, 0, sizeof(hashInfo));
+    hashInfo.keysize = E164PrefixAttributeMaximumLength + 1;
+    hashInfo.entrysize = sizeof(E164PrefixStringOffset);
+    hashInfo.hcxt = CurrentMemoryContext;
+#if PG_VERSION_NUM >= 140000
+    hashFlags |= HASH_STRINGS;
+#endif
+    aBuild->stringOffsets = hash_create("e164 prefix attributes", 1024,
+                                        &hashInfo, hashFlags);
+    initStringInfo(&aBuild->strings);
+
+    aBuild->allocatedEntries = 1024;
+    aBuild->entries = palloc(aBuild->allocatedEntries *
+                             sizeof(E164PrefixBuildEntry));
+
+    if (!(file = AllocateFile(aBuild->path, "r")))
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not open e164 prefix file \"%s\": %m",
+                        aBuild->path)));
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char * fields[E164NumberOfPrefixAttributes + 1];
+        int numberOfFields = 0;
+        int length = strlen(line);
+        char * p;
+
+        ++lineNumber;
+        if (length > 0 && line[length - 1] == '\n')
+            line[--length] = '\0';
+        else if (!feof(file))
+            ereport(ERROR,
+                    (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                     errmsg("line %d of e164 prefix file \"%s\" is too long",
+                            lineNumber, aBuild->path)));
+        if (length > 0 && line[length - 1] == '\r')
+            line[--length] = '\0';
+
+        if (!length || line[0] == '#')
+            continue;
+
+        fields[numberOfFields++] = line;
+        for (p = line; *p; ++p)
+        {
+            if (*p != '\t')
+                continue;
+            if (numberOfFields == lengthof(fields))
+                ereport(ERROR,
+                        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                         errmsg("too many fields at line %d of e164 prefix file \"%s\"",
+                                lineNumber, aBuild->path)));
+            *p = '\0';
+            fields[numberOfFields++] = p + 1;
+        }
+
+        addPrefixEntry(aBuild, fields, numberOfFields, lineNumber);
+    }
+
+    if (ferror(file))
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not read e164 prefix file \"%s\": %m",
+                        aBuild->path)));
+    FreeFile(file);
+}
+
+static void
+addPrefixEntry(E164PrefixBuild * aBuild, char ** fields, int numberOfFields,
+               int lineNumber)
+{
+    E164PrefixBuildEntry * entry;
+    const char * prefix = fields[0];
+    int attribute;
+
+    if (stringHasValidE164Prefix(prefix))
+        prefix += E164PrefixStringLength;
+
+    if (!*prefix || strspn(prefix, "0123456789") != strlen(prefix) ||
+        strlen(prefix) > E164MaximumNumberOfDigits)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid prefix \"%s\" at line %d of e164 prefix file \"%s\"",
+                        fields[0], lineNumber, aBuild->path),
+                 errhint("Prefixes consist of 1 to %d digits, optionally preceded by \"%s\".",
+                         E164MaximumNumberOfDigits, E164_PREFIX_STRING)));
+
+    if (aBuild->numberOfEntries == aBuild->allocatedEntries)
+    {
+        aBuild->allocatedEntries *= 2;
+        aBuild->entries = repalloc_huge(aBuild->entries,
+                                        aBuild->allocatedEntries *
+                                        sizeof(E164PrefixBuildEntry));
+    }
+    entry = aBuild->entries + aBuild->numberOfEntries++;
+
+    strlcpy(entry->digits, prefix, sizeof(entry->digits));
+    entry->length = strlen(entry->digits);
+    entry->lineNumber = lineNumber;
+
+    for (attribute = 0; attribute < E164NumberOfPrefixAttributes; ++attribute)
+    {
+        const char * value = (attribute + 1 < numberOfFields) ?
+            fields[attribute + 1] : "";
+        entry->attributes[attribute] = *value ?
+            internPrefixAttribute(aBuild, value, lineNumber) :
+            E164PrefixAttributeUndefined;
+    }
+}
+
+/*
+ * internPrefixAttribute returns the offset of aString in the snapshot
+ * strings area, adding it there on first use.  Carrier, region and time
+ * zone names repeat heavily across prefixes, so each is stored only once.
+ */
+static uint32
+internPrefixAttribute(E164PrefixBuild * aBuild, const char * aString,
+                      int lineNumber)
+{
+    E164PrefixStringOffset * stringOffset;
+    bool found;
+    int length = strlen(aString);
+
+    if (length > E164PrefixAttributeMaximumLength)
+        ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("attribute value too long at line %d of e164 prefix file \"%s\"",
+                        lineNumber, aBuild->path),
+                 errhint("Attribute values must have at most %d bytes.",
+                         E164PrefixAttributeMaximumLength)));
+
+    stringOffset = hash_search(aBuild->stringOffsets, aString, HASH_ENTER,
+                               &found);
+    if (!found)
+    {
+        stringOffset->offset = aBuild->strings.len;
+        appendBinaryStringInfo(&aBuild->strings, aString, length + 1);
+    }
+    return stringOffset->offset;
+}
+
+static int
+comparePrefixBuildEntries(const void * a, const void * b)
+{
+    return strcmp(((const E164PrefixBuildEntry *) a)->digits,
+                  ((const E164PrefixBuildEntry *) b)->digits);
+}
+
+/*
+ * countPrefixNodes returns the number of trie nodes needed for the sorted
+ * entries [low, high), which all share their first depth digits.
+ *
+ * Since a prefix sorts before its extensions, an entry ending at this
+ * node can only be the first one of the range.
+ */
+static uint32
+countPrefixNodes(const E164PrefixBuildEntry * entries, int low, int high,
+                 int depth)
+{
+    uint32 numberOfNodes = 1;
+
+    if (low < high && entries[low].length == depth)
+        ++low;
+
+    while (low < high)
+    {
+        char digit = entries[low].digits[depth];
+        int childHigh = low;
+
+        while (childHigh < high && entries[childHigh].digits[depth] == digit)
+            ++childHigh;
+        numberOfNodes += countPrefixNodes(entries, low, childHigh, depth + 1);
+        low = childHigh;
+    }
+    return numberOfNodes;
+}
+
+/*
+ * layoutPrefixNodes writes the node for the sorted entries [low, high) at
+ * nodeIndex, reserving a contiguous block for its children at nextFreeNode
+ * before descending into them.
+ */
+static void
+layoutPrefixNodes(const E164PrefixBuildEntry * entries, int low, int high,
+                  int depth, E164PrefixNode * nodes, uint32 nodeIndex,
+                  uint32 * nextFreeNode)
+{
+    E164PrefixNode * node = nodes + nodeIndex;
+    uint32 childIndex;
+    int i;
+
+    node->childMap = 0;
+    node->entry = E164PrefixNoEntry;
+
+    if (low < high && entries[low].length == depth)
+        node->entry = low++;
+
+    for (i = low; i < high; ++i)
+        node->childMap |= (1 << (entries[i].digits[depth] - '0'));
+
+    node->firstChild = *nextFreeNode;
+    childIndex = *nextFreeNode;
+    *nextFreeNode += pg_number_of_ones[node->childMap & 0xFF] +
+        pg_number_of_ones[node->childMap >> 8];
+
+    while (low < high)
+    {
+        char digit = entries[low].digits[depth];
+        int childHigh = low;
+
+        while (childHigh < high && entries[childHigh].digits[depth] == digit)
+            ++childHigh;
+        layoutPrefixNodes(entries, low, childHigh, depth + 1,
+                          nodes, childIndex++, nextFreeNode);
+        low = childHigh;
+    }
+}
+
+E164PrefixAttribute
+e164PrefixAttributeFromName(const char * aName)
+{
+    int attribute;
+
+    for (attribute = 0; attribute < E164NumberOfPrefixAttributes; ++attribute)
+        if (strcmp(aName, prefixAttributeNames[attribute]) == 0)
+            return (E164PrefixAttribute) attribute;
+
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("unknown e164 prefix attribute: \"%s\"", aName),
+             errhint("Valid attributes are \"carrier\", \"region\" and \"timezone\".")));
+    return E164NumberOfPrefixAttributes; /* keep compiler quiet */
+}
+
+/*
+ * e164PrefixLookup assigns to aString the value of anAttribute for the
+ * longest prefix of aNumber which defines it, returning false if there is
+ * no such prefix.  No locks are taken unless a reload is pending, in which
+ * case the prefix file is loaded first if it has changed: the result of a
+ * lookup may thus change from one call to the next, and e164_lookup is
+ * volatile.
+ */
+bool
+e164PrefixLookup(E164 aNumber, E164PrefixAttribute anAttribute,
+                 char * aString, int stringLength)
+{
+    char numberString[E164MaximumStringLength + 1];
+    const char * digits = numberString + E164PrefixStringLength;
+
+    (void) rawStringFromE164(numberString, sizeof(numberString), aNumber);
+
+    if (!prefixState || prefixReloadPending ||
+        pg_atomic_read_u32(&prefixState->activeSnapshot) == E164PrefixNoSnapshot)
+        (void) e164PrefixReload(false);
+
+    for (;;)
+    {
+        E164PrefixSnapshot * snapshot;
+        uint64 changeCount;
+        bool found;
+
+        snapshot = prefixSnapshot(pg_atomic_read_u32(&prefixState->activeSnapshot));
+        changeCount = pg_atomic_read_u64(&snapshot->changeCount);
+        if (changeCount & 1)
+        {
+            /* the slot is being rewritten by another reload */
+            pg_spin_delay();
+            CHECK_FOR_INTERRUPTS();
+            continue;
+        }
+
+        pg_read_barrier();
+        found = walkPrefixSnapshot(snapshot, digits, anAttribute,
+                                   aString, stringLength);
+        pg_read_barrier();
+
+        if (pg_atomic_read_u64(&snapshot->changeCount) == changeCount)
+            return found;
+    }
+}
+
+/*
+ * walkPrefixSnapshot does the actual trie walk.  As the snapshot may be
+ * rewritten concurrently, every index read from it is checked against the
+ * slot bounds; the caller discards the result of an inconsistent walk.
+ */
+static bool
+walkPrefixSnapshot(const E164PrefixSnapshot * aSnapshot, const char * digits,
+                   E164PrefixAttribute anAttribute,
+                   char * aString, int stringLength)
+{
+    uint32 numberOfNodes = aSnapshot->numberOfNodes;
+    uint32 numberOfEntries = aSnapshot->numberOfEntries;
+    uint32 stringsSize = aSnapshot->stringsSize;
+    const E164PrefixNode * nodes;
+    const E164PrefixEntry * entries;
+    const char * strings;
+    uint32 match = E164PrefixAttributeUndefined;
+    uint32 nodeIndex = 0;
+    size_t length;
+    const char * p;
+
+    if (numberOfNodes == 0 ||
+        prefixSnapshotDataSize(numberOfNodes, numberOfEntries,
+                               stringsSize) > prefixState->snapshotSize)
+        return false;
+
+    nodes = prefixNodesOf(aSnapshot);
+    entries = (const E164PrefixEntry *) (nodes + numberOfNodes);
+    strings = (const char *) (entries + numberOfEntries);
+
+    for (p = digits; ; ++p)
+    {
+        const E164PrefixNode * node = nodes + nodeIndex;
+        uint16 lowerChildren;
+
+        if (node->entry >= 0 && (uint32) node->entry < numberOfEntries &&
+            entries[node->entry].attributes[anAttribute] != E164PrefixAttributeUndefined)
+            match = entries[node->entry].attributes[anAttribute];
+
+        if (!isdigit((unsigned char) *p) ||
+            !(node->childMap & (1 << (*p - '0'))))
+            break;
+
+        lowerChildren = node->childMap & ((1 << (*p - '0')) - 1);
+        nodeIndex = node->firstChild +
+            pg_number_of_ones[lowerChildren & 0xFF] +
+            pg_number_of_ones[lowerChildren >> 8];
+        if (nodeIndex >= numberOfNodes)
+            return false;
+    }
+
+    if (match >= stringsSize)
+        return false;
+
+    /* a string without its terminator within the slot is a torn read */
+    length = strnlen(strings + match, stringsSize - match);
+    if (length == stringsSize - match)
+        return false;
+    if (length >= (size_t) stringLength)
+        length = stringLength - 1;
+    memcpy(aString, strings + match, length);
+    aString[length] = '\0';
+    return true;
+}
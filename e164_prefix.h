@@ -0,0 +1,64 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Prefix metadata lookups
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef E164_PREFIX_H
+#define E164_PREFIX_H
+
+#include "e164_base.h"
+
+/*
+ * The attributes which may be attached to a number prefix in the prefix
+ * data file, in the order of the file columns following the prefix.
+ */
+typedef enum E164PrefixAttribute
+{
+    E164PrefixCarrier,
+    E164PrefixRegion,
+    E164PrefixTimeZone,
+    E164NumberOfPrefixAttributes
+} E164PrefixAttribute;
+
+/* Note this does *not* include the string terminator */
+#define E164PrefixAttributeMaximumLength 255
+
+extern char * e164PrefixFile;
+extern int e164PrefixMemory;
+
+extern void e164PrefixInit(void);
+extern void e164PrefixRequestReload(void);
+extern uint64 e164PrefixReload(bool force);
+
+extern E164PrefixAttribute e164PrefixAttributeFromName(const char * aName);
+extern bool e164PrefixLookup(E164 aNumber, E164PrefixAttribute anAttribute,
+                             char * aString, int stringLength);
+
+#endif /* !E164_PREFIX_H */
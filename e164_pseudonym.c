@@ -0,0 +1,246 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Pseudonymization and tokenization
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "e164_base.h"
+
+/*
+ * Exports which must not reveal the numbers they mention replace them
+ * with values computed under a secret 16-byte key:
+ *
+ * e164_pseudonymize returns SipHash-2-4 of the digits of the number,
+ * country code included, as eight little-endian bytes: the same value
+ * SipHash gives for the bigint cast of the number anywhere else.  It is a
+ * stable pseudonym, which cannot be reversed or recomputed without the
+ * key, and is much cheaper than an HMAC over the formatted number.
+ *
+ * e164_tokenize returns a number of the same country code and length,
+ * which therefore is a valid E164 number itself, and e164_detokenize
+ * reverses it.  The national significant number is enciphered as a string
+ * of decimal digits by a Feistel network in the manner of FF1 (NIST SP
+ * 800-38G): ten rounds over its two halves, adding modulo a power of ten
+ * a round function of the other half, here SipHash-2-4 of that half, the
+ * round number, the length and the country code, which thereby act as the
+ * tweak.  Numbers of each country code and length are thus permuted among
+ * themselves, leading zeros included.
+ */
+#define E164PseudonymKeyLength   16
+#define E164TokenRounds          10
+
+typedef struct E164PseudonymKey
+{
+    uint64 k0;
+    uint64 k1;
+} E164PseudonymKey;
+
+Datum e164_pseudonymize(PG_FUNCTION_ARGS);
+Datum e164_tokenize(PG_FUNCTION_ARGS);
+Datum e164_detokenize(PG_FUNCTION_ARGS);
+
+static void pseudonymKeyFromBytea(E164PseudonymKey * aKey, bytea * someBytes);
+static uint64 sipHash24(const E164PseudonymKey * aKey, uint64 aMessage);
+static E164 e164Tokenization(E164 aNumber, const E164PseudonymKey * aKey,
+                             bool decipher);
+
+static const uint64 tokenPowersOfTen[] = {
+    UINT64CONST(1),
+    UINT64CONST(10),
+    UINT64CONST(100),
+    UINT64CONST(1000),
+    UINT64CONST(10000),
+    UINT64CONST(100000),
+    UINT64CONST(1000000),
+    UINT64CONST(10000000),
+    UINT64CONST(100000000),
+    UINT64CONST(1000000000),
+    UINT64CONST(10000000000),
+    UINT64CONST(100000000000),
+    UINT64CONST(1000000000000),
+    UINT64CONST(10000000000000),
+    UINT64CONST(100000000000000),
+    UINT64CONST(1000000000000000)
+};
+
+static void
+pseudonymKeyFromBytea (E164PseudonymKey * aKey, bytea * someBytes)
+{
+    const uint8 * theBytes = (const uint8 *) VARDATA_ANY(someBytes);
+    int i;
+
+    if (E164PseudonymKeyLength != VARSIZE_ANY_EXHDR(someBytes))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("E164 pseudonymization key must be %d bytes long",
+                        E164PseudonymKeyLength)));
+
+    aKey->k0 = 0;
+    aKey->k1 = 0;
+    for (i = 7; i >= 0; --i)
+    {
+        aKey->k0 = (aKey->k0 << 8) | theBytes[i];
+        aKey->k1 = (aKey->k1 << 8) | theBytes[i + 8];
+    }
+}
+
+#define SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3) \
+    do { \
+        v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+        v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+    } while (0)
+
+/*
+ * sipHash24 returns SipHash-2-4 under aKey of the eight bytes of aMessage
+ * in little-endian order, the only message length needed here.
+ */
+static uint64
+sipHash24 (const E164PseudonymKey * aKey, uint64 aMessage)
+{
+    uint64 v0 = aKey->k0 ^ UINT64CONST(0x736f6d6570736575);
+    uint64 v1 = aKey->k1 ^ UINT64CONST(0x646f72616e646f6d);
+    uint64 v2 = aKey->k0 ^ UINT64CONST(0x6c7967656e657261);
+    uint64 v3 = aKey->k1 ^ UINT64CONST(0x7465646279746573);
+    uint64 theLastBlock = ((uint64) sizeof(aMessage)) << 56;
+
+    v3 ^= aMessage;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= aMessage;
+
+    v3 ^= theLastBlock;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= theLastBlock;
+
+    v2 ^= 0xff;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    return (v0 ^ v1 ^ v2 ^ v3);
+}
+
+/*
+ * e164Tokenization enciphers, or deciphers, the national significant
+ * number of aNumber under aKey.  Its n digits are split into a left half
+ * A of n / 2 digits and a right half B of the rest; each round replaces
+ * (A, B) by (B, (A + F(B)) mod 10^m), m being the length of A, and
+ * deciphering runs the rounds backwards, subtracting instead.  Halves
+ * have at most seven digits, so that the round function input, B with
+ * the round, length and country code above it, fits one SipHash block.
+ */
+static E164
+e164Tokenization (E164 aNumber, const E164PseudonymKey * aKey, bool decipher)
+{
+    uint8 theDigits[E164MaximumNumberOfDigits];
+    int numberOfDigits = digitsFromE164(theDigits, aNumber);
+    E164CountryCode theCountryCode = countryCodeOfE164(aNumber);
+    int numberOfCountryCodeDigits = (theCountryCode < 10) ? 1 :
+                                    (theCountryCode < 100) ? 2 : 3;
+    int n = numberOfDigits - numberOfCountryCodeDigits;
+    int u = n / 2;
+    int v = n - u;
+    uint64 theTweak = ((uint64) theCountryCode << 32) | ((uint64) n << 28);
+    uint64 a = 0;
+    uint64 b = 0;
+    int i;
+
+    for (i = 0; i < u; i++)
+        a = a * 10 + theDigits[numberOfCountryCodeDigits + i];
+    for (i = u; i < n; i++)
+        b = b * 10 + theDigits[numberOfCountryCodeDigits + i];
+
+    if (!decipher)
+    {
+        for (i = 0; i < E164TokenRounds; i++)
+        {
+            uint64 theModulus = tokenPowersOfTen[(i % 2) ? v : u];
+            uint64 y = sipHash24(aKey, theTweak | ((uint64) i << 24) | b);
+            uint64 c = (a + y % theModulus) % theModulus;
+
+            a = b;
+            b = c;
+        }
+    }
+    else
+    {
+        for (i = E164TokenRounds - 1; i >= 0; i--)
+        {
+            uint64 theModulus = tokenPowersOfTen[(i % 2) ? v : u];
+            uint64 c = b;
+            uint64 y;
+
+            b = a;
+            y = sipHash24(aKey, theTweak | ((uint64) i << 24) | b);
+            a = (c + theModulus - y % theModulus) % theModulus;
+        }
+    }
+
+    /* Ten rounds leave the halves in their original places and lengths */
+    return e164FromParts(theCountryCode, (int64) (a * tokenPowersOfTen[v] + b),
+                         n);
+}
+
+PG_FUNCTION_INFO_V1(e164_pseudonymize);
+Datum
+e164_pseudonymize(PG_FUNCTION_ARGS)
+{
+    E164PseudonymKey theKey;
+
+    pseudonymKeyFromBytea(&theKey, PG_GETARG_BYTEA_PP(1));
+    PG_RETURN_INT64((int64) sipHash24(&theKey,
+                                      e164DigitsOf(PG_GETARG_E164(0))));
+}
+
+PG_FUNCTION_INFO_V1(e164_tokenize);
+Datum
+e164_tokenize(PG_FUNCTION_ARGS)
+{
+    E164PseudonymKey theKey;
+
+    pseudonymKeyFromBytea(&theKey, PG_GETARG_BYTEA_PP(1));
+    PG_RETURN_E164(e164Tokenization(PG_GETARG_E164(0), &theKey, false));
+}
+
+PG_FUNCTION_INFO_V1(e164_detokenize);
+Datum
+e164_detokenize(PG_FUNCTION_ARGS)
+{
+    E164PseudonymKey theKey;
+
+    pseudonymKeyFromBytea(&theKey, PG_GETARG_BYTEA_PP(1));
+    PG_RETURN_E164(e164Tokenization(PG_GETARG_E164(0), &theKey, true));
+}
@@ -0,0 +1,93 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Range type support
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "utils/rangetypes.h"
+#include "e164_base.h"
+
+/*
+ * e164range is a discrete range type over e164.  Its ranges are
+ * canonicalized to the [) form using e164Successor, so that e.g.
+ * [+1 415 555 0000, +1 415 555 0999] and [+1 415 555 0000, +1 415 555 1000)
+ * compare equal.
+ */
+Datum e164range_canonical(PG_FUNCTION_ARGS);
+Datum e164range_subdiff(PG_FUNCTION_ARGS);
+
+
+PG_FUNCTION_INFO_V1(e164range_canonical);
+Datum
+e164range_canonical(PG_FUNCTION_ARGS)
+{
+    RangeType *      range = PG_GETARG_RANGE_P(0);
+    TypeCacheEntry * typcache;
+    RangeBound       lower;
+    RangeBound       upper;
+    bool             empty;
+
+    typcache = range_get_typcache(fcinfo, RangeTypeGetOid(range));
+    range_deserialize(typcache, range, &lower, &upper, &empty);
+
+    if (empty)
+        PG_RETURN_RANGE_P(range);
+
+    if (!lower.infinite && !lower.inclusive)
+    {
+        lower.val = E164PGetDatum(e164Successor(DatumGetE164P(lower.val)));
+        lower.inclusive = true;
+    }
+
+    if (!upper.infinite && upper.inclusive)
+    {
+        upper.val = E164PGetDatum(e164Successor(DatumGetE164P(upper.val)));
+        upper.inclusive = false;
+    }
+
+#if PG_VERSION_NUM >= 160000
+    PG_RETURN_RANGE_P(range_serialize(typcache, &lower, &upper, false, NULL));
+#else
+    PG_RETURN_RANGE_P(range_serialize(typcache, &lower, &upper, false));
+#endif
+}
+
+/*
+ * e164range_subdiff is the difference of two numbers in the comparison
+ * order, i.e., the numeric difference for numbers of one country code.
+ */
+PG_FUNCTION_INFO_V1(e164range_subdiff);
+Datum
+e164range_subdiff(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_FLOAT8((float8) e164Comparison(PG_GETARG_E164(0),
+                                             PG_GETARG_E164(1)));
+}
@@ -0,0 +1,478 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Planner statistics and selectivity estimation
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include <math.h>
+#include "fmgr.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/vacuum.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "e164_base.h"
+#include "e164_digits.h"
+#include "e164_selfuncs.h"
+
+/*
+ * Statistics on e164 columns are the standard scalar statistics, whose
+ * histogram runs through the numbers of each country code in turn, plus
+ * the fraction of rows in each country code (see e164_selfuncs.h).
+ * Together they let the estimators below answer equality, country code
+ * and prefix predicates, which the generic estimators treat as opaque
+ * integers.
+ */
+typedef struct E164AnalyzeExtraData
+{
+    AnalyzeAttrComputeStatsFunc standardComputeStats;
+    void *                      standardExtraData;
+} E164AnalyzeExtraData;
+
+/*
+ * Below this many histogram bounds in a country code, the fraction of them
+ * matching a prefix says little, and the digits after the country code are
+ * taken to be uniformly distributed instead.
+ */
+#define E164MinimumCountryCodeHistogramBounds 10
+
+Datum e164_typanalyze(PG_FUNCTION_ARGS);
+Datum e164_eqsel(PG_FUNCTION_ARGS);
+Datum e164_eqjoinsel(PG_FUNCTION_ARGS);
+Datum e164_prefixsel(PG_FUNCTION_ARGS);
+
+static void computeE164Stats(VacAttrStats * stats,
+                             AnalyzeAttrFetchFunc fetchfunc,
+                             int samplerows, double totalrows);
+static float8 unseenSelectivity(VariableStatData * vardata);
+static int  countryCodeDigits(E164CountryCode aCountryCode, char * digits);
+static float8 countryCodePrefixSelectivity(VariableStatData * vardata,
+                                           E164CountryCode aCountryCode,
+                                           float8 aFrequency,
+                                           const E164DigitPattern * aPrefix,
+                                           int numberOfPrefixDigits);
+
+
+PG_FUNCTION_INFO_V1(e164_typanalyze);
+Datum
+e164_typanalyze(PG_FUNCTION_ARGS)
+{
+    VacAttrStats * stats = (VacAttrStats *) PG_GETARG_POINTER(0);
+    E164AnalyzeExtraData * theExtraData;
+
+    if (!std_typanalyze(stats))
+        PG_RETURN_BOOL(false);
+
+    theExtraData = palloc(sizeof(E164AnalyzeExtraData));
+    theExtraData->standardComputeStats = stats->compute_stats;
+    theExtraData->standardExtraData = stats->extra_data;
+    stats->compute_stats = computeE164Stats;
+    stats->extra_data = theExtraData;
+    PG_RETURN_BOOL(true);
+}
+
+/*
+ * computeE164Stats computes the standard statistics, then counts the rows
+ * of the sample in each country code into a slot of its own.
+ */
+static void
+computeE164Stats(VacAttrStats * stats, AnalyzeAttrFetchFunc fetchfunc,
+                 int samplerows, double totalrows)
+{
+    E164AnalyzeExtraData * theExtraData = stats->extra_data;
+    int *   counts;
+    Datum * theValues;
+    float4 * theNumbers;
+    int     numberOfCountryCodes = 0;
+    int     slot;
+    int     i;
+    MemoryContext theOldContext;
+
+    stats->extra_data = theExtraData->standardExtraData;
+    theExtraData->standardComputeStats(stats, fetchfunc, samplerows,
+                                       totalrows);
+    stats->extra_data = theExtraData;
+
+    if (!stats->stats_valid)
+        return;
+    for (slot = 0; slot < STATISTIC_NUM_SLOTS; slot++)
+        if (0 == stats->stakind[slot])
+            break;
+    if (STATISTIC_NUM_SLOTS == slot)
+        return;
+
+    counts = palloc0(sizeof(int) * (E164_MAX_COUNTRY_CODE_VALUE + 1));
+    for (i = 0; i < samplerows; i++)
+    {
+        bool  isNull;
+        Datum theValue = fetchfunc(stats, i, &isNull);
+        E164CountryCode theCountryCode;
+
+        if (isNull)
+            continue;
+        theCountryCode = countryCodeOfE164(DatumGetE164P(theValue));
+        if (0 == counts[theCountryCode]++)
+            numberOfCountryCodes++;
+    }
+    if (0 == numberOfCountryCodes)
+    {
+        pfree(counts);
+        return;
+    }
+
+    theOldContext = MemoryContextSwitchTo(stats->anl_context);
+    theValues = palloc(sizeof(Datum) * numberOfCountryCodes);
+    theNumbers = palloc(sizeof(float4) * numberOfCountryCodes);
+    MemoryContextSwitchTo(theOldContext);
+
+    numberOfCountryCodes = 0;
+    for (i = 0; i <= E164_MAX_COUNTRY_CODE_VALUE; i++)
+        if (counts[i] > 0)
+        {
+            theValues[numberOfCountryCodes] = Int32GetDatum(i);
+            theNumbers[numberOfCountryCodes] =
+                (float4) ((double) counts[i] / samplerows);
+            numberOfCountryCodes++;
+        }
+    pfree(counts);
+
+    stats->stakind[slot] = STATISTIC_KIND_E164_COUNTRY_CODES;
+    stats->staop[slot] = InvalidOid;
+    stats->stanumbers[slot] = theNumbers;
+    stats->numnumbers[slot] = numberOfCountryCodes;
+    stats->stavalues[slot] = theValues;
+    stats->numvalues[slot] = numberOfCountryCodes;
+    stats->statypid[slot] = INT4OID;
+    stats->statyplen[slot] = sizeof(int32);
+    stats->statypbyval[slot] = true;
+    stats->statypalign[slot] = 'i';
+}
+
+/*
+ * e164CountryCodeFrequencies assigns the fraction of rows in each country
+ * code, indexed by country code, to frequencies, which must have room for
+ * E164_MAX_COUNTRY_CODE_VALUE + 1 values.  Returns false if the variable
+ * has no country code statistics.
+ */
+bool
+e164CountryCodeFrequencies(VariableStatData * vardata, float8 * frequencies)
+{
+    AttStatsSlot theSlot;
+    int i;
+
+    if (!HeapTupleIsValid(vardata->statsTuple) ||
+        !get_attstatsslot(&theSlot, vardata->statsTuple,
+                          STATISTIC_KIND_E164_COUNTRY_CODES, InvalidOid,
+                          ATTSTATSSLOT_VALUES | ATTSTATSSLOT_NUMBERS))
+        return false;
+
+    memset(frequencies, 0,
+           sizeof(float8) * (E164_MAX_COUNTRY_CODE_VALUE + 1));
+    for (i = 0; i < theSlot.nvalues && i < theSlot.nnumbers; i++)
+    {
+        E164CountryCode theCountryCode = DatumGetInt32(theSlot.values[i]);
+
+        if (e164CountryCodeIsInRange(theCountryCode))
+            frequencies[theCountryCode] = theSlot.numbers[i];
+    }
+    free_attstatsslot(&theSlot);
+    return true;
+}
+
+/*
+ * unseenSelectivity is the selectivity assumed for values of a country
+ * code missing from the sample: a single row.
+ */
+static float8
+unseenSelectivity(VariableStatData * vardata)
+{
+    if (NULL != vardata->rel && vardata->rel->tuples > 1)
+        return 1.0 / vardata->rel->tuples;
+    return 1.0;
+}
+
+/*
+ * countryCodeDigits assigns the digits of aCountryCode, as characters, to
+ * digits, returning the number of digits.
+ */
+static int
+countryCodeDigits(E164CountryCode aCountryCode, char * digits)
+{
+    return snprintf(digits, E164MaximumCountryCodeLength + 1, "%d",
+                    aCountryCode);
+}
+
+/*
+ * e164_eqsel is eqsel, capped at the fraction of rows in the country code
+ * of the constant: eqsel knows the most common numbers, but spreads the
+ * rest of the rows evenly across all numbers, whatever their country code.
+ */
+PG_FUNCTION_INFO_V1(e164_eqsel);
+Datum
+e164_eqsel(PG_FUNCTION_ARGS)
+{
+    PlannerInfo * root = (PlannerInfo *) PG_GETARG_POINTER(0);
+    List *        args = (List *) PG_GETARG_POINTER(2);
+    int           varRelid = PG_GETARG_INT32(3);
+    float8        theSelectivity;
+    VariableStatData vardata;
+    Node *        other;
+    bool          varonleft;
+    float8        frequencies[E164_MAX_COUNTRY_CODE_VALUE + 1];
+
+    theSelectivity = DatumGetFloat8(DirectFunctionCall4(eqsel,
+                                                        PG_GETARG_DATUM(0),
+                                                        PG_GETARG_DATUM(1),
+                                                        PG_GETARG_DATUM(2),
+                                                        PG_GETARG_DATUM(3)));
+
+    if (!get_restriction_variable(root, args, varRelid,
+                                  &vardata, &other, &varonleft))
+        PG_RETURN_FLOAT8(theSelectivity);
+
+    if (IsA(other, Const) && !((Const *) other)->constisnull &&
+        e164CountryCodeFrequencies(&vardata, frequencies))
+    {
+        E164 theNumber = DatumGetE164P(((Const *) other)->constvalue);
+        float8 theFrequency = frequencies[countryCodeOfE164(theNumber)];
+
+        theSelectivity = Min(theSelectivity,
+                             Max(theFrequency, unseenSelectivity(&vardata)));
+    }
+
+    ReleaseVariableStats(vardata);
+    PG_RETURN_FLOAT8(theSelectivity);
+}
+
+/*
+ * e164_eqjoinsel is eqjoinsel, capped at the chance of two rows being of
+ * the same country code, or for semi and anti joins, of an outer row being
+ * of a country code the inner side has.  Columns of numbers of disjoint
+ * sets of countries, e.g., domestic and roaming subscribers, join to
+ * nothing.
+ */
+PG_FUNCTION_INFO_V1(e164_eqjoinsel);
+Datum
+e164_eqjoinsel(PG_FUNCTION_ARGS)
+{
+    PlannerInfo *     root = (PlannerInfo *) PG_GETARG_POINTER(0);
+    List *            args = (List *) PG_GETARG_POINTER(2);
+    JoinType          jointype = (JoinType) PG_GETARG_INT16(3);
+    SpecialJoinInfo * sjinfo = (SpecialJoinInfo *) PG_GETARG_POINTER(4);
+    float8            theSelectivity;
+    VariableStatData  vardata1;
+    VariableStatData  vardata2;
+    bool              join_is_reversed;
+    float8            frequencies1[E164_MAX_COUNTRY_CODE_VALUE + 1];
+    float8            frequencies2[E164_MAX_COUNTRY_CODE_VALUE + 1];
+
+    theSelectivity = DatumGetFloat8(DirectFunctionCall5(eqjoinsel,
+                                                        PG_GETARG_DATUM(0),
+                                                        PG_GETARG_DATUM(1),
+                                                        PG_GETARG_DATUM(2),
+                                                        PG_GETARG_DATUM(3),
+                                                        PG_GETARG_DATUM(4)));
+
+    get_join_variables(root, args, sjinfo, &vardata1, &vardata2,
+                       &join_is_reversed);
+    if (e164CountryCodeFrequencies(&vardata1, frequencies1) &&
+        e164CountryCodeFrequencies(&vardata2, frequencies2))
+    {
+        float8 * outerFrequencies = frequencies1;
+        float8 * innerFrequencies = frequencies2;
+        float8   theBound = 0.0;
+        int      i;
+
+        if (join_is_reversed)
+        {
+            outerFrequencies = frequencies2;
+            innerFrequencies = frequencies1;
+        }
+        for (i = 0; i <= E164_MAX_COUNTRY_CODE_VALUE; i++)
+        {
+            if (JOIN_SEMI == jointype || JOIN_ANTI == jointype)
+            {
+                if (innerFrequencies[i] > 0.0)
+                    theBound += outerFrequencies[i];
+            }
+            else
+                theBound += outerFrequencies[i] * innerFrequencies[i];
+        }
+        theSelectivity = Min(theSelectivity, theBound);
+    }
+
+    ReleaseVariableStats(vardata1);
+    ReleaseVariableStats(vardata2);
+    CLAMP_PROBABILITY(theSelectivity);
+    PG_RETURN_FLOAT8(theSelectivity);
+}
+
+/*
+ * countryCodePrefixSelectivity estimates the fraction of rows of a country
+ * code, making up aFrequency of the rows, which begin with a prefix longer
+ * than the country code: the most common numbers matching, plus the rest
+ * of the rows of the country code in the proportion of its histogram
+ * bounds matching.
+ */
+static float8
+countryCodePrefixSelectivity(VariableStatData * vardata,
+                             E164CountryCode aCountryCode, float8 aFrequency,
+                             const E164DigitPattern * aPrefix,
+                             int numberOfPrefixDigits)
+{
+    AttStatsSlot theSlot;
+    float8 commonFrequency = 0.0;
+    float8 commonMatchingFrequency = 0.0;
+    float8 theFraction;
+    int numberOfBounds = 0;
+    int numberOfMatchingBounds = 0;
+    int i;
+
+    if (get_attstatsslot(&theSlot, vardata->statsTuple,
+                         STATISTIC_KIND_MCV, InvalidOid,
+                         ATTSTATSSLOT_VALUES | ATTSTATSSLOT_NUMBERS))
+    {
+        for (i = 0; i < theSlot.nvalues; i++)
+        {
+            E164 theNumber = DatumGetE164P(theSlot.values[i]);
+
+            if (countryCodeOfE164(theNumber) != aCountryCode)
+                continue;
+            commonFrequency += theSlot.numbers[i];
+            if (e164MatchesDigitPattern(theNumber, aPrefix))
+                commonMatchingFrequency += theSlot.numbers[i];
+        }
+        free_attstatsslot(&theSlot);
+    }
+
+    if (get_attstatsslot(&theSlot, vardata->statsTuple,
+                         STATISTIC_KIND_HISTOGRAM, InvalidOid,
+                         ATTSTATSSLOT_VALUES))
+    {
+        for (i = 0; i < theSlot.nvalues; i++)
+        {
+            E164 theNumber = DatumGetE164P(theSlot.values[i]);
+
+            if (countryCodeOfE164(theNumber) != aCountryCode)
+                continue;
+            numberOfBounds++;
+            if (e164MatchesDigitPattern(theNumber, aPrefix))
+                numberOfMatchingBounds++;
+        }
+        free_attstatsslot(&theSlot);
+    }
+
+    if (numberOfBounds >= E164MinimumCountryCodeHistogramBounds)
+        theFraction = (float8) numberOfMatchingBounds / numberOfBounds;
+    else
+    {
+        char theDigits[E164MaximumCountryCodeLength + 1];
+
+        theFraction = pow(10.0, countryCodeDigits(aCountryCode, theDigits) -
+                                numberOfPrefixDigits);
+    }
+
+    return (commonMatchingFrequency +
+            Max(aFrequency - commonFrequency, 0.0) * theFraction);
+}
+
+/*
+ * e164_prefixsel estimates n ^@ prefix from the country code statistics:
+ * every row of the country codes beginning with the prefix, and if the
+ * prefix is longer than a country code, the rows of that country code
+ * beginning with it.  Without statistics, matchingsel is used.
+ */
+PG_FUNCTION_INFO_V1(e164_prefixsel);
+Datum
+e164_prefixsel(PG_FUNCTION_ARGS)
+{
+    PlannerInfo * root = (PlannerInfo *) PG_GETARG_POINTER(0);
+    List *        args = (List *) PG_GETARG_POINTER(2);
+    int           varRelid = PG_GETARG_INT32(3);
+    float8        theSelectivity = 0.0;
+    VariableStatData vardata;
+    Node *        other;
+    bool          varonleft;
+    float8        frequencies[E164_MAX_COUNTRY_CODE_VALUE + 1];
+    E164DigitPattern thePrefix;
+    int           numberOfPrefixDigits;
+    int           i;
+
+    if (!get_restriction_variable(root, args, varRelid,
+                                  &vardata, &other, &varonleft))
+        return DirectFunctionCall4(matchingsel,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3));
+
+    if (!varonleft || !IsA(other, Const) ||
+        !e164CountryCodeFrequencies(&vardata, frequencies))
+    {
+        ReleaseVariableStats(vardata);
+        return DirectFunctionCall4(matchingsel,
+                                   PG_GETARG_DATUM(0), PG_GETARG_DATUM(1),
+                                   PG_GETARG_DATUM(2), PG_GETARG_DATUM(3));
+    }
+    if (((Const *) other)->constisnull)
+    {
+        ReleaseVariableStats(vardata);
+        PG_RETURN_FLOAT8(0.0);
+    }
+
+    parseE164DigitPrefix(TextDatumGetCString(((Const *) other)->constvalue),
+                         &thePrefix);
+    /* The prefix pattern is its digits followed by "%" */
+    numberOfPrefixDigits = thePrefix.length - 1;
+
+    for (i = 0; i <= E164_MAX_COUNTRY_CODE_VALUE; i++)
+    {
+        char theCountryCode[E164MaximumCountryCodeLength + 1];
+        int  numberOfCountryCodeDigits;
+
+        if (0.0 == frequencies[i])
+            continue;
+        numberOfCountryCodeDigits = countryCodeDigits(i, theCountryCode);
+        if (numberOfPrefixDigits <= numberOfCountryCodeDigits)
+        {
+            if (0 == strncmp(theCountryCode, thePrefix.symbols,
+                             numberOfPrefixDigits))
+                theSelectivity += frequencies[i];
+        }
+        else if (0 == strncmp(theCountryCode, thePrefix.symbols,
+                              numberOfCountryCodeDigits))
+            theSelectivity += countryCodePrefixSelectivity(&vardata, i,
+                                                           frequencies[i],
+                                                           &thePrefix,
+                                                           numberOfPrefixDigits);
+    }
+
+    ReleaseVariableStats(vardata);
+    CLAMP_PROBABILITY(theSelectivity);
+    PG_RETURN_FLOAT8(theSelectivity);
+}
@@ -0,0 +1,1099 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Number sets
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "port/pg_bitutils.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "e164_base.h"
+
+/*
+ * An e164set is a set of numbers stored the way Roaring bitmaps are: the
+ * numbers, as their comparison values, are partitioned by all but their
+ * low 16 bits, the container key, which combines the country code and the
+ * high bits of the number.  Each container holds the low 16 bits of its
+ * numbers, as a sorted array of uint16 while it has up to 4096 of them,
+ * and as a 65536-bit bitmap beyond that, so no container takes more than
+ * 8 kB and dense blocks of numbers cost about a bit per number.
+ *
+ * The container headers, sorted by key, come first, followed by the
+ * containers themselves, each starting on an 8-byte boundary.  Bitmaps
+ * are arrays of bytes, with the bit for n being bit (n % 8) of byte n / 8,
+ * so only the arrays depend on the byte order of the platform.
+ */
+#define E164SetContainerBits       16
+#define E164SetContainerSize       (1 << E164SetContainerBits)
+#define E164SetContainerMask       (E164SetContainerSize - 1)
+#define E164SetMaximumArrayLength  4096
+#define E164SetBitmapLength        (E164SetContainerSize / 8)
+
+typedef struct E164SetContainerHeader
+{
+    uint64 key;
+    uint32 offset;      /* from the end of the headers */
+    uint32 count;       /* numbers in the container, 1 to 65536 */
+} E164SetContainerHeader;
+
+typedef struct E164Set
+{
+    int32                  vl_len_;
+    uint32                 numberOfContainers;
+    E164SetContainerHeader containers[FLEXIBLE_ARRAY_MEMBER];
+} E164Set;
+
+#define E164SetHeaderSize(n) \
+    (offsetof(E164Set, containers) + (n) * sizeof(E164SetContainerHeader))
+#define E164SetPayload(aSet) \
+    ((char *) (aSet) + E164SetHeaderSize((aSet)->numberOfContainers))
+#define isBitmapContainer(aHeader) \
+    ((aHeader)->count > E164SetMaximumArrayLength)
+#define containerValues(aSet, aHeader) \
+    ((const uint16 *) (E164SetPayload(aSet) + (aHeader)->offset))
+#define containerBitmap(aSet, aHeader) \
+    ((const uint8 *) (E164SetPayload(aSet) + (aHeader)->offset))
+
+#define bitmapContains(aBitmap, aValue) \
+    (0 != ((aBitmap)[(aValue) / 8] & (1 << ((aValue) % 8))))
+#define bitmapAdd(aBitmap, aValue) \
+    ((aBitmap)[(aValue) / 8] |= (1 << ((aValue) % 8)))
+
+#define DatumGetE164SetP(X)   ((E164Set *) PG_DETOAST_DATUM(X))
+#define PG_GETARG_E164SET(n)  DatumGetE164SetP(PG_GETARG_DATUM(n))
+#define PG_RETURN_E164SET(x)  PG_RETURN_POINTER(x)
+
+/*
+ * An E164SetWriter assembles an e164set from containers added in key
+ * order.
+ */
+typedef struct E164SetWriter
+{
+    E164SetContainerHeader * headers;
+    int                      numberOfContainers;
+    int                      allocatedContainers;
+    StringInfoData           payload;
+} E164SetWriter;
+
+/*
+ * An E164SetBuilder collects numbers in any order, as e164set_agg and
+ * e164set_in do.  Array containers are appended to, and only sorted, and
+ * rid of duplicates, once full or when the set is written; a container
+ * still more than three quarters full after that becomes a bitmap.
+ */
+typedef struct E164SetBuilderContainer
+{
+    uint64   key;           /* hash key, must be first */
+    uint32   length;
+    uint32   allocatedLength;
+    uint16 * values;
+    uint8 *  bitmap;        /* once no longer an array */
+} E164SetBuilderContainer;
+
+typedef struct E164SetBuilder
+{
+    MemoryContext context;
+    HTAB *        containers;
+} E164SetBuilder;
+
+typedef enum E164SetOperation
+{
+    E164SetUnion,
+    E164SetIntersection,
+    E164SetDifference
+} E164SetOperation;
+
+Datum e164set_in(PG_FUNCTION_ARGS);
+Datum e164set_out(PG_FUNCTION_ARGS);
+Datum e164set_recv(PG_FUNCTION_ARGS);
+Datum e164set_send(PG_FUNCTION_ARGS);
+
+Datum e164set_contains(PG_FUNCTION_ARGS);
+Datum e164set_contained(PG_FUNCTION_ARGS);
+Datum e164set_cardinality(PG_FUNCTION_ARGS);
+Datum e164set_union(PG_FUNCTION_ARGS);
+Datum e164set_intersect(PG_FUNCTION_ARGS);
+Datum e164set_except(PG_FUNCTION_ARGS);
+
+Datum e164set_agg_transfn(PG_FUNCTION_ARGS);
+Datum e164set_agg_finalfn(PG_FUNCTION_ARGS);
+Datum e164set_agg_combinefn(PG_FUNCTION_ARGS);
+Datum e164set_agg_serialfn(PG_FUNCTION_ARGS);
+Datum e164set_agg_deserialfn(PG_FUNCTION_ARGS);
+
+static void initE164SetWriter(E164SetWriter * aWriter);
+static E164SetContainerHeader * addContainerHeader(E164SetWriter * aWriter,
+                                                   uint64 aKey, uint32 count);
+static void writeArrayContainer(E164SetWriter * aWriter, uint64 aKey,
+                                const uint16 * values, uint32 count);
+static void writeBitmapContainer(E164SetWriter * aWriter, uint64 aKey,
+                                 const uint8 * aBitmap);
+static void writeContainer(E164SetWriter * aWriter, const E164Set * aSet,
+                           const E164SetContainerHeader * aHeader);
+static E164Set * finishE164SetWriter(E164SetWriter * aWriter);
+
+static E164SetBuilder * newE164SetBuilder(MemoryContext aContext);
+static E164SetBuilderContainer * builderContainer(E164SetBuilder * aBuilder,
+                                                  uint64 aKey);
+static void builderAdd(E164SetBuilder * aBuilder, E164 aNumber);
+static void builderAddValue(E164SetBuilder * aBuilder,
+                            E164SetBuilderContainer * aContainer,
+                            uint16 aValue);
+static void builderAddSet(E164SetBuilder * aBuilder, const E164Set * aSet);
+static void builderAddBuilder(E164SetBuilder * aBuilder,
+                              E164SetBuilder * anotherBuilder);
+static void makeBitmapContainer(E164SetBuilder * aBuilder,
+                                E164SetBuilderContainer * aContainer);
+static E164Set * finishE164SetBuilder(E164SetBuilder * aBuilder);
+
+static int  compareValues(const void * a, const void * b);
+static int  compareBuilderContainers(const void * a, const void * b);
+static uint32 sortUniqueValues(uint16 * values, uint32 count);
+static void bitmapFromContainer(uint8 * aBitmap, const E164Set * aSet,
+                                const E164SetContainerHeader * aHeader);
+static const E164SetContainerHeader * findContainer(const E164Set * aSet,
+                                                    uint64 aKey);
+static bool e164SetContains(const E164Set * aSet, E164 aNumber);
+static E164Set * combineE164Sets(const E164Set * aSet,
+                                 const E164Set * anotherSet,
+                                 E164SetOperation anOperation);
+static void writeCombinedContainers(E164SetWriter * aWriter,
+                                    const E164Set * aSet,
+                                    const E164SetContainerHeader * aHeader,
+                                    const E164Set * anotherSet,
+                                    const E164SetContainerHeader * anotherHeader,
+                                    E164SetOperation anOperation);
+static void checkE164SetNumber(E164 aNumber);
+static void appendE164(StringInfo aString, E164 aNumber, bool * isFirst);
+
+
+/*
+ * E164SetWriter
+ */
+static void
+initE164SetWriter(E164SetWriter * aWriter)
+{
+    aWriter->numberOfContainers = 0;
+    aWriter->allocatedContainers = 16;
+    aWriter->headers = palloc(aWriter->allocatedContainers *
+                              sizeof(E164SetContainerHeader));
+    initStringInfo(&aWriter->payload);
+}
+
+static E164SetContainerHeader *
+addContainerHeader(E164SetWriter * aWriter, uint64 aKey, uint32 count)
+{
+    E164SetContainerHeader * theHeader;
+    static const char padding[8] = {0};
+
+    if (aWriter->numberOfContainers == aWriter->allocatedContainers)
+    {
+        aWriter->allocatedContainers *= 2;
+        aWriter->headers = repalloc(aWriter->headers,
+                                    aWriter->allocatedContainers *
+                                    sizeof(E164SetContainerHeader));
+    }
+    if (aWriter->payload.len % 8)
+        appendBinaryStringInfo(&aWriter->payload, padding,
+                               8 - aWriter->payload.len % 8);
+
+    theHeader = &aWriter->headers[aWriter->numberOfContainers++];
+    theHeader->key = aKey;
+    theHeader->offset = aWriter->payload.len;
+    theHeader->count = count;
+    return theHeader;
+}
+
+/*
+ * writeArrayContainer writes a container of count sorted, distinct values,
+ * as a bitmap if there are too many for an array.
+ */
+static void
+writeArrayContainer(E164SetWriter * aWriter, uint64 aKey,
+                    const uint16 * values, uint32 count)
+{
+    uint8  theBitmap[E164SetBitmapLength];
+    uint32 i;
+
+    if (0 == count)
+        return;
+    if (count <= E164SetMaximumArrayLength)
+    {
+        addContainerHeader(aWriter, aKey, count);
+        appendBinaryStringInfo(&aWriter->payload, (const char *) values,
+                               count * sizeof(uint16));
+        return;
+    }
+    memset(theBitmap, 0, E164SetBitmapLength);
+    for (i = 0; i < count; i++)
+        bitmapAdd(theBitmap, values[i]);
+    addContainerHeader(aWriter, aKey, count);
+    appendBinaryStringInfo(&aWriter->payload, (const char *) theBitmap,
+                           E164SetBitmapLength);
+}
+
+/*
+ * writeBitmapContainer writes a container from a bitmap, as an array if it
+ * has few enough bits set.
+ */
+static void
+writeBitmapContainer(E164SetWriter * aWriter, uint64 aKey,
+                     const uint8 * aBitmap)
+{
+    uint32 count = (uint32) pg_popcount((const char *) aBitmap,
+                                        E164SetBitmapLength);
+    uint16 values[E164SetMaximumArrayLength];
+    uint32 numberOfValues = 0;
+    uint32 i;
+
+    if (0 == count)
+        return;
+    if (count > E164SetMaximumArrayLength)
+    {
+        addContainerHeader(aWriter, aKey, count);
+        appendBinaryStringInfo(&aWriter->payload, (const char *) aBitmap,
+                               E164SetBitmapLength);
+        return;
+    }
+    for (i = 0; i < E164SetContainerSize; i++)
+        if (bitmapContains(aBitmap, i))
+            values[numberOfValues++] = i;
+    writeArrayContainer(aWriter, aKey, values, numberOfValues);
+}
+
+static void
+writeContainer(E164SetWriter * aWriter, const E164Set * aSet,
+               const E164SetContainerHeader * aHeader)
+{
+    addContainerHeader(aWriter, aHeader->key, aHeader->count);
+    appendBinaryStringInfo(&aWriter->payload,
+                           E164SetPayload(aSet) + aHeader->offset,
+                           isBitmapContainer(aHeader)
+                           ? E164SetBitmapLength
+                           : aHeader->count * sizeof(uint16));
+}
+
+static E164Set *
+finishE164SetWriter(E164SetWriter * aWriter)
+{
+    Size headerSize = E164SetHeaderSize(aWriter->numberOfContainers);
+    Size theSize = headerSize + aWriter->payload.len;
+    E164Set * theSet;
+
+    if (!AllocSizeIsValid(theSize))
+        ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("e164set too large")));
+    theSet = palloc(theSize);
+    SET_VARSIZE(theSet, theSize);
+    theSet->numberOfContainers = aWriter->numberOfContainers;
+    memcpy(theSet->containers, aWriter->headers,
+           aWriter->numberOfContainers * sizeof(E164SetContainerHeader));
+    memcpy((char *) theSet + headerSize, aWriter->payload.data,
+           aWriter->payload.len);
+    pfree(aWriter->headers);
+    pfree(aWriter->payload.data);
+    return theSet;
+}
+
+/*
+ * E164SetBuilder
+ */
+static E164SetBuilder *
+newE164SetBuilder(MemoryContext aContext)
+{
+    E164SetBuilder * theBuilder;
+    HASHCTL hashInfo;
+
+    theBuilder = MemoryContextAlloc(aContext, sizeof(E164SetBuilder));
+    theBuilder->context = aContext;
+    memset(&hashInfo, 0, sizeof(hashInfo));
+    hashInfo.keysize = sizeof(uint64);
+    hashInfo.entrysize = sizeof(E164SetBuilderContainer);
+    hashInfo.hcxt = aContext;
+    theBuilder->containers = hash_create("e164set containers", 256, &hashInfo,
+                                         HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+    return theBuilder;
+}
+
+static E164SetBuilderContainer *
+builderContainer(E164SetBuilder * aBuilder, uint64 aKey)
+{
+    E164SetBuilderContainer * theContainer;
+    bool found;
+
+    theContainer = hash_search(aBuilder->containers, &aKey, HASH_ENTER,
+                               &found);
+    if (!found)
+    {
+        theContainer->length = 0;
+        theContainer->allocatedLength = 0;
+        theContainer->values = NULL;
+        theContainer->bitmap = NULL;
+    }
+    return theContainer;
+}
+
+static void
+makeBitmapContainer(E164SetBuilder * aBuilder,
+                    E164SetBuilderContainer * aContainer)
+{
+    uint32 i;
+
+    aContainer->bitmap = MemoryContextAllocZero(aBuilder->context,
+                                                E164SetBitmapLength);
+    for (i = 0; i < aContainer->length; i++)
+        bitmapAdd(aContainer->bitmap, aContainer->values[i]);
+    if (aContainer->values)
+        pfree(aContainer->values);
+    aContainer->values = NULL;
+    aContainer->length = 0;
+    aContainer->allocatedLength = 0;
+}
+
+static void
+builderAddValue(E164SetBuilder * aBuilder,
+                E164SetBuilderContainer * aContainer, uint16 aValue)
+{
+    if (aContainer->bitmap)
+    {
+        bitmapAdd(aContainer->bitmap, aValue);
+        return;
+    }
+    if (aContainer->length == aContainer->allocatedLength)
+    {
+        if (aContainer->allocatedLength == E164SetMaximumArrayLength)
+        {
+            aContainer->length = sortUniqueValues(aContainer->values,
+                                                  aContainer->length);
+            if (aContainer->length > E164SetMaximumArrayLength / 4 * 3)
+            {
+                makeBitmapContainer(aBuilder, aContainer);
+                bitmapAdd(aContainer->bitmap, aValue);
+                return;
+            }
+        }
+        else if (0 == aContainer->allocatedLength)
+        {
+            aContainer->allocatedLength = 8;
+            aContainer->values = MemoryContextAlloc(aBuilder->context,
+                                                    8 * sizeof(uint16));
+        }
+        else
+        {
+            aContainer->allocatedLength = Min(aContainer->allocatedLength * 2,
+                                              E164SetMaximumArrayLength);
+            aContainer->values = repalloc(aContainer->values,
+                                          aContainer->allocatedLength *
+                                          sizeof(uint16));
+        }
+    }
+    aContainer->values[aContainer->length++] = aValue;
+}
+
+static void
+builderAdd(E164SetBuilder * aBuilder, E164 aNumber)
+{
+    builderAddValue(aBuilder,
+                    builderContainer(aBuilder,
+                                     aNumber >> E164SetContainerBits),
+                    aNumber & E164SetContainerMask);
+}
+
+static void
+builderAddSet(E164SetBuilder * aBuilder, const E164Set * aSet)
+{
+    uint32 i;
+    uint32 j;
+
+    for (i = 0; i < aSet->numberOfContainers; i++)
+    {
+        const E164SetContainerHeader * theHeader = &aSet->containers[i];
+        E164SetBuilderContainer * theContainer =
+            builderContainer(aBuilder, theHeader->key);
+
+        if (isBitmapContainer(theHeader))
+        {
+            const uint8 * theBitmap = containerBitmap(aSet, theHeader);
+
+            if (NULL == theContainer->bitmap)
+                makeBitmapContainer(aBuilder, theContainer);
+            for (j = 0; j < E164SetBitmapLength; j++)
+                theContainer->bitmap[j] |= theBitmap[j];
+        }
+        else
+        {
+            const uint16 * values = containerValues(aSet, theHeader);
+
+            for (j = 0; j < theHeader->count; j++)
+                builderAddValue(aBuilder, theContainer, values[j]);
+        }
+    }
+}
+
+static void
+builderAddBuilder(E164SetBuilder * aBuilder, E164SetBuilder * anotherBuilder)
+{
+    HASH_SEQ_STATUS status;
+    E164SetBuilderContainer * theOther;
+    uint32 i;
+
+    hash_seq_init(&status, anotherBuilder->containers);
+    while (NULL != (theOther = hash_seq_search(&status)))
+    {
+        E164SetBuilderContainer * theContainer =
+            builderContainer(aBuilder, theOther->key);
+
+        if (theOther->bitmap)
+        {
+            if (NULL == theContainer->bitmap)
+                makeBitmapContainer(aBuilder, theContainer);
+            for (i = 0; i < E164SetBitmapLength; i++)
+                theContainer->bitmap[i] |= theOther->bitmap[i];
+        }
+        else
+            for (i = 0; i < theOther->length; i++)
+                builderAddValue(aBuilder, theContainer, theOther->values[i]);
+    }
+}
+
+static int
+compareValues(const void * a, const void * b)
+{
+    return (int) *(const uint16 *) a - (int) *(const uint16 *) b;
+}
+
+static int
+compareBuilderContainers(const void * a, const void * b)
+{
+    uint64 first = (*(E164SetBuilderContainer * const *) a)->key;
+    uint64 second = (*(E164SetBuilderContainer * const *) b)->key;
+
+    return (first > second) - (first < second);
+}
+
+static uint32
+sortUniqueValues(uint16 * values, uint32 count)
+{
+    uint32 numberOfValues = 0;
+    uint32 i;
+
+    qsort(values, count, sizeof(uint16), compareValues);
+    for (i = 0; i < count; i++)
+        if (0 == i || values[i] != values[numberOfValues - 1])
+            values[numberOfValues++] = values[i];
+    return numberOfValues;
+}
+
+/*
+ * finishE164SetBuilder returns the set of the numbers added to aBuilder,
+ * which remains usable.
+ */
+static E164Set *
+finishE164SetBuilder(E164SetBuilder * aBuilder)
+{
+    long numberOfContainers = hash_get_num_entries(aBuilder->containers);
+    E164SetBuilderContainer ** theContainers;
+    E164SetBuilderContainer * theContainer;
+    HASH_SEQ_STATUS status;
+    E164SetWriter theWriter;
+    long i = 0;
+
+    theContainers = palloc(Max(numberOfContainers, 1) *
+                           sizeof(E164SetBuilderContainer *));
+    hash_seq_init(&status, aBuilder->containers);
+    while (NULL != (theContainer = hash_seq_search(&status)))
+        theContainers[i++] = theContainer;
+    qsort(theContainers, numberOfContainers,
+          sizeof(E164SetBuilderContainer *), compareBuilderContainers);
+
+    initE164SetWriter(&theWriter);
+    for (i = 0; i < numberOfContainers; i++)
+    {
+        theContainer = theContainers[i];
+        if (theContainer->bitmap)
+            writeBitmapContainer(&theWriter, theContainer->key,
+                                 theContainer->bitmap);
+        else
+        {
+            theContainer->length = sortUniqueValues(theContainer->values,
+                                                    theContainer->length);
+            writeArrayContainer(&theWriter, theContainer->key,
+                                theContainer->values, theContainer->length);
+        }
+    }
+    pfree(theContainers);
+    return finishE164SetWriter(&theWriter);
+}
+
+/*
+ * Set operations
+ */
+static void
+bitmapFromContainer(uint8 * aBitmap, const E164Set * aSet,
+                    const E164SetContainerHeader * aHeader)
+{
+    if (isBitmapContainer(aHeader))
+        memcpy(aBitmap, containerBitmap(aSet, aHeader), E164SetBitmapLength);
+    else
+    {
+        const uint16 * values = containerValues(aSet, aHeader);
+        uint32 i;
+
+        memset(aBitmap, 0, E164SetBitmapLength);
+        for (i = 0; i < aHeader->count; i++)
+            bitmapAdd(aBitmap, values[i]);
+    }
+}
+
+static const E164SetContainerHeader *
+findContainer(const E164Set * aSet, uint64 aKey)
+{
+    int low = 0;
+    int high = (int) aSet->numberOfContainers - 1;
+
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        uint64 theKey = aSet->containers[middle].key;
+
+        if (theKey == aKey)
+            return &aSet->containers[middle];
+        if (theKey < aKey)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return NULL;
+}
+
+static bool
+e164SetContains(const E164Set * aSet, E164 aNumber)
+{
+    const E164SetContainerHeader * theHeader =
+        findContainer(aSet, aNumber >> E164SetContainerBits);
+    uint16 theValue = aNumber & E164SetContainerMask;
+    const uint16 * values;
+    int low;
+    int high;
+
+    if (NULL == theHeader)
+        return false;
+    if (isBitmapContainer(theHeader))
+        return bitmapContains(containerBitmap(aSet, theHeader), theValue);
+
+    values = containerValues(aSet, theHeader);
+    low = 0;
+    high = (int) theHeader->count - 1;
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+
+        if (values[middle] == theValue)
+            return true;
+        if (values[middle] < theValue)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return false;
+}
+
+/*
+ * writeCombinedContainers writes the result of anOperation on two
+ * containers with the same key.  Two arrays are merged; anything else
+ * goes through bitmaps.
+ */
+static void
+writeCombinedContainers(E164SetWriter * aWriter,
+                        const E164Set * aSet,
+                        const E164SetContainerHeader * aHeader,
+                        const E164Set * anotherSet,
+                        const E164SetContainerHeader * anotherHeader,
+                        E164SetOperation anOperation)
+{
+    if (!isBitmapContainer(aHeader) && !isBitmapContainer(anotherHeader))
+    {
+        const uint16 * values = containerValues(aSet, aHeader);
+        const uint16 * otherValues = containerValues(anotherSet, anotherHeader);
+        uint16 result[2 * E164SetMaximumArrayLength];
+        uint32 count = 0;
+        uint32 i = 0;
+        uint32 j = 0;
+
+        while (i < aHeader->count || j < anotherHeader->count)
+        {
+            bool inFirst;
+            bool inSecond;
+            uint16 theValue;
+
+            if (j == anotherHeader->count ||
+                (i < aHeader->count && values[i] < otherValues[j]))
+            {
+                theValue = values[i++];
+                inFirst = true;
+                inSecond = false;
+            }
+            else if (i == aHeader->count || otherValues[j] < values[i])
+            {
+                theValue = otherValues[j++];
+                inFirst = false;
+                inSecond = true;
+            }
+            else
+            {
+                theValue = values[i++];
+                j++;
+                inFirst = inSecond = true;
+            }
+
+            if ((E164SetUnion == anOperation) ||
+                (E164SetIntersection == anOperation && inFirst && inSecond) ||
+                (E164SetDifference == anOperation && inFirst && !inSecond))
+                result[count++] = theValue;
+        }
+        writeArrayContainer(aWriter, aHeader->key, result, count);
+    }
+    else
+    {
+        uint8 theBitmap[E164SetBitmapLength];
+        uint8 theOtherBitmap[E164SetBitmapLength];
+        int i;
+
+        bitmapFromContainer(theBitmap, aSet, aHeader);
+        bitmapFromContainer(theOtherBitmap, anotherSet, anotherHeader);
+        for (i = 0; i < E164SetBitmapLength; i++)
+        {
+            switch (anOperation)
+            {
+                case E164SetUnion:
+                    theBitmap[i] |= theOtherBitmap[i];
+                    break;
+                case E164SetIntersection:
+                    theBitmap[i] &= theOtherBitmap[i];
+                    break;
+                case E164SetDifference:
+                    theBitmap[i] &= ~theOtherBitmap[i];
+                    break;
+            }
+        }
+        writeBitmapContainer(aWriter, aHeader->key, theBitmap);
+    }
+}
+
+static E164Set *
+combineE164Sets(const E164Set * aSet, const E164Set * anotherSet,
+                E164SetOperation anOperation)
+{
+    E164SetWriter theWriter;
+    uint32 i = 0;
+    uint32 j = 0;
+
+    initE164SetWriter(&theWriter);
+    while (i < aSet->numberOfContainers || j < anotherSet->numberOfContainers)
+    {
+        const E164SetContainerHeader * theHeader = &aSet->containers[i];
+        const E164SetContainerHeader * theOtherHeader =
+            &anotherSet->containers[j];
+
+        if (j == anotherSet->numberOfContainers ||
+            (i < aSet->numberOfContainers &&
+             theHeader->key < theOtherHeader->key))
+        {
+            if (E164SetIntersection != anOperation)
+                writeContainer(&theWriter, aSet, theHeader);
+            i++;
+        }
+        else if (i == aSet->numberOfContainers ||
+                 theOtherHeader->key < theHeader->key)
+        {
+            if (E164SetUnion == anOperation)
+                writeContainer(&theWriter, anotherSet, theOtherHeader);
+            j++;
+        }
+        else
+        {
+            writeCombinedContainers(&theWriter, aSet, theHeader,
+                                    anotherSet, theOtherHeader, anOperation);
+            i++;
+            j++;
+        }
+    }
+    return finishE164SetWriter(&theWriter);
+}
+
+static void
+checkE164SetNumber(E164 aNumber)
+{
+    if (e164FromDigits(e164DigitsOf(aNumber)) != aNumber)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                 errmsg("invalid E164 number in e164set")));
+}
+
+static void
+appendE164(StringInfo aString, E164 aNumber, bool * isFirst)
+{
+    char theNumber[E164MaximumRawStringLength + 1];
+
+    if (!*isFirst)
+        appendStringInfoChar(aString, ',');
+    *isFirst = false;
+    (void) rawStringFromE164(theNumber, sizeof(theNumber), aNumber);
+    appendStringInfoString(aString, theNumber);
+}
+
+/*
+ * The text format is that of an array of numbers:
+ * {+14155550123,+442073779923}
+ */
+PG_FUNCTION_INFO_V1(e164set_in);
+Datum
+e164set_in(PG_FUNCTION_ARGS)
+{
+    char * theString = PG_GETARG_CSTRING(0);
+    char * theCharacter = theString;
+    E164SetBuilder * theBuilder = newE164SetBuilder(CurrentMemoryContext);
+    char theNumber[E164MaximumStringLength + 1];
+
+    while (isspace((unsigned char) *theCharacter))
+        theCharacter++;
+    if ('{' != *theCharacter++)
+        goto bad_format;
+    while (isspace((unsigned char) *theCharacter))
+        theCharacter++;
+    if ('}' != *theCharacter)
+    {
+        for (;;)
+        {
+            int length = strcspn(theCharacter, ",}");
+
+            if ('\0' == theCharacter[length] || 0 == length)
+                goto bad_format;
+            while (length > 0 && isspace((unsigned char) theCharacter[length - 1]))
+                length--;
+            if (length > E164MaximumStringLength)
+                goto bad_format;
+            memcpy(theNumber, theCharacter, length);
+            theNumber[length] = '\0';
+            builderAdd(theBuilder, e164FromString(theNumber));
+
+            theCharacter += strcspn(theCharacter, ",}");
+            if ('}' == *theCharacter)
+                break;
+            theCharacter++;
+            while (isspace((unsigned char) *theCharacter))
+                theCharacter++;
+        }
+    }
+    theCharacter++;
+    while (isspace((unsigned char) *theCharacter))
+        theCharacter++;
+    if ('\0' != *theCharacter)
+        goto bad_format;
+
+    PG_RETURN_E164SET(finishE164SetBuilder(theBuilder));
+
+bad_format:
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+             errmsg("invalid input syntax for type e164set: \"%s\"", theString),
+             errhint("Number sets are written as {+14155550123,+442073779923}.")));
+    PG_RETURN_NULL(); /* keep compiler quiet */
+}
+
+PG_FUNCTION_INFO_V1(e164set_out);
+Datum
+e164set_out(PG_FUNCTION_ARGS)
+{
+    E164Set * theSet = PG_GETARG_E164SET(0);
+    StringInfoData theString;
+    bool isFirst = true;
+    uint32 i;
+    uint32 j;
+
+    initStringInfo(&theString);
+    appendStringInfoChar(&theString, '{');
+    for (i = 0; i < theSet->numberOfContainers; i++)
+    {
+        const E164SetContainerHeader * theHeader = &theSet->containers[i];
+        E164 theBase = theHeader->key << E164SetContainerBits;
+
+        if (isBitmapContainer(theHeader))
+        {
+            const uint8 * theBitmap = containerBitmap(theSet, theHeader);
+
+            for (j = 0; j < E164SetContainerSize; j++)
+                if (bitmapContains(theBitmap, j))
+                    appendE164(&theString, theBase | j, &isFirst);
+        }
+        else
+        {
+            const uint16 * values = containerValues(theSet, theHeader);
+
+            for (j = 0; j < theHeader->count; j++)
+                appendE164(&theString, theBase | values[j], &isFirst);
+        }
+    }
+    appendStringInfoChar(&theString, '}');
+    PG_RETURN_CSTRING(theString.data);
+}
+
+/*
+ * The binary format is the number of containers, then each container's
+ * key and count, followed by its values as int2 if there are at most 4096,
+ * and by its bitmap otherwise.
+ */
+PG_FUNCTION_INFO_V1(e164set_recv);
+Datum
+e164set_recv(PG_FUNCTION_ARGS)
+{
+    StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+    uint32 numberOfContainers = (uint32) pq_getmsgint(buf, 4);
+    E164SetWriter theWriter;
+    uint64 previousKey = 0;
+    uint32 i;
+    uint32 j;
+
+    initE164SetWriter(&theWriter);
+    for (i = 0; i < numberOfContainers; i++)
+    {
+        uint64 theKey = (uint64) pq_getmsgint64(buf);
+        uint32 count = (uint32) pq_getmsgint(buf, 4);
+        E164 theBase = theKey << E164SetContainerBits;
+
+        if ((i > 0 && theKey <= previousKey) ||
+            (theKey >> (64 - E164SetContainerBits)) != 0 ||
+            0 == count || count > E164SetContainerSize)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                     errmsg("invalid e164set container")));
+        previousKey = theKey;
+
+        if (count <= E164SetMaximumArrayLength)
+        {
+            uint16 values[E164SetMaximumArrayLength];
+
+            for (j = 0; j < count; j++)
+            {
+                values[j] = (uint16) pq_getmsgint(buf, 2);
+                if (j > 0 && values[j] <= values[j - 1])
+                    ereport(ERROR,
+                            (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                             errmsg("invalid e164set container")));
+                checkE164SetNumber(theBase | values[j]);
+            }
+            writeArrayContainer(&theWriter, theKey, values, count);
+        }
+        else
+        {
+            const uint8 * theBitmap =
+                (const uint8 *) pq_getmsgbytes(buf, E164SetBitmapLength);
+
+            if (pg_popcount((const char *) theBitmap, E164SetBitmapLength) != count)
+                ereport(ERROR,
+                        (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                         errmsg("invalid e164set container")));
+            for (j = 0; j < E164SetContainerSize; j++)
+                if (bitmapContains(theBitmap, j))
+                    checkE164SetNumber(theBase | j);
+            writeBitmapContainer(&theWriter, theKey, theBitmap);
+        }
+    }
+    PG_RETURN_E164SET(finishE164SetWriter(&theWriter));
+}
+
+PG_FUNCTION_INFO_V1(e164set_send);
+Datum
+e164set_send(PG_FUNCTION_ARGS)
+{
+    E164Set * theSet = PG_GETARG_E164SET(0);
+    StringInfoData buf;
+    uint32 i;
+    uint32 j;
+
+    pq_begintypsend(&buf);
+    pq_sendint32(&buf, theSet->numberOfContainers);
+    for (i = 0; i < theSet->numberOfContainers; i++)
+    {
+        const E164SetContainerHeader * theHeader = &theSet->containers[i];
+
+        pq_sendint64(&buf, (int64) theHeader->key);
+        pq_sendint32(&buf, theHeader->count);
+        if (isBitmapContainer(theHeader))
+            pq_sendbytes(&buf, (const char *) containerBitmap(theSet, theHeader),
+                         E164SetBitmapLength);
+        else
+            for (j = 0; j < theHeader->count; j++)
+                pq_sendint16(&buf, containerValues(theSet, theHeader)[j]);
+    }
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(e164set_contains);
+Datum
+e164set_contains(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(e164SetContains((E164Set *) e164StableArgument(fcinfo, 0),
+                                   PG_GETARG_E164(1)));
+}
+
+PG_FUNCTION_INFO_V1(e164set_contained);
+Datum
+e164set_contained(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(e164SetContains((E164Set *) e164StableArgument(fcinfo, 1),
+                                   PG_GETARG_E164(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164set_cardinality);
+Datum
+e164set_cardinality(PG_FUNCTION_ARGS)
+{
+    E164Set * theSet = PG_GETARG_E164SET(0);
+    int64 cardinality = 0;
+    uint32 i;
+
+    for (i = 0; i < theSet->numberOfContainers; i++)
+        cardinality += theSet->containers[i].count;
+    PG_RETURN_INT64(cardinality);
+}
+
+PG_FUNCTION_INFO_V1(e164set_union);
+Datum
+e164set_union(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164SET(combineE164Sets(PG_GETARG_E164SET(0),
+                                      PG_GETARG_E164SET(1),
+                                      E164SetUnion));
+}
+
+PG_FUNCTION_INFO_V1(e164set_intersect);
+Datum
+e164set_intersect(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164SET(combineE164Sets(PG_GETARG_E164SET(0),
+                                      PG_GETARG_E164SET(1),
+                                      E164SetIntersection));
+}
+
+PG_FUNCTION_INFO_V1(e164set_except);
+Datum
+e164set_except(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_E164SET(combineE164Sets(PG_GETARG_E164SET(0),
+                                      PG_GETARG_E164SET(1),
+                                      E164SetDifference));
+}
+
+/*
+ * e164set_agg collects numbers in an E164SetBuilder; partial aggregates
+ * are serialized as e164set values.
+ */
+PG_FUNCTION_INFO_V1(e164set_agg_transfn);
+Datum
+e164set_agg_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164SetBuilder * theBuilder;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164set_agg_transfn called in non-aggregate context");
+
+    theBuilder = PG_ARGISNULL(0)
+        ? newE164SetBuilder(aggContext)
+        : (E164SetBuilder *) PG_GETARG_POINTER(0);
+    if (!PG_ARGISNULL(1))
+        builderAdd(theBuilder, PG_GETARG_E164(1));
+    PG_RETURN_POINTER(theBuilder);
+}
+
+PG_FUNCTION_INFO_V1(e164set_agg_finalfn);
+Datum
+e164set_agg_finalfn(PG_FUNCTION_ARGS)
+{
+    if (PG_ARGISNULL(0))
+        PG_RETURN_NULL();
+    PG_RETURN_E164SET(finishE164SetBuilder((E164SetBuilder *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164set_agg_combinefn);
+Datum
+e164set_agg_combinefn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164SetBuilder * theBuilder;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164set_agg_combinefn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    theBuilder = PG_ARGISNULL(0)
+        ? newE164SetBuilder(aggContext)
+        : (E164SetBuilder *) PG_GETARG_POINTER(0);
+    builderAddBuilder(theBuilder, (E164SetBuilder *) PG_GETARG_POINTER(1));
+    PG_RETURN_POINTER(theBuilder);
+}
+
+PG_FUNCTION_INFO_V1(e164set_agg_serialfn);
+Datum
+e164set_agg_serialfn(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BYTEA_P(finishE164SetBuilder((E164SetBuilder *) PG_GETARG_POINTER(0)));
+}
+
+PG_FUNCTION_INFO_V1(e164set_agg_deserialfn);
+Datum
+e164set_agg_deserialfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164SetBuilder * theBuilder;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164set_agg_deserialfn called in non-aggregate context");
+
+    /*
+     * The serialized state is a bytea, which is only int-aligned, while the
+     * container headers hold uint64 keys: copy it into aligned memory
+     * before reading it.
+     */
+    theBuilder = newE164SetBuilder(aggContext);
+    builderAddSet(theBuilder,
+                  (E164Set *) PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(0)));
+    PG_RETURN_POINTER(theBuilder);
+}
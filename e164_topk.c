@@ -0,0 +1,539 @@
+/*
+ * E.164 Telephone Number Type for PostgreSQL: Top-K aggregates
+ *
+ * Portions Copyright (c) 2007-2011, Michael Glaesemann
+ * Portions Copyright (c) 2011, CommandPrompt, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
+#include "e164_base.h"
+
+/*
+ * e164_topk(n, k) finds the k most frequent numbers with the Space-Saving
+ * algorithm, in memory proportional to k whatever the number of rows: it
+ * keeps 4k counters and, when a number without a counter arrives and all
+ * are taken, reassigns the smallest one, whose count becomes the error of
+ * the new number.  Each reported count overestimates the true count by at
+ * most its error, and every number occurring more than 1/4k of the time
+ * is reported.
+ *
+ * The counters are kept in a min-heap by count, so that the smallest one
+ * is at hand, and are found by number through an open-addressing hash
+ * table of heap positions with linear probing; each counter records its
+ * slot, to keep the table in step when heap entries move.
+ */
+#define E164TopKMaximumK        10000
+#define E164TopKCounterFactor   4
+
+typedef struct E164TopKCounter
+{
+    E164 number;
+    int64 count;
+    int64 error;
+    int32 slot;
+} E164TopKCounter;
+
+typedef struct E164TopK
+{
+    int32 k;
+    int32 capacity;
+    int32 numberOfCounters;
+    uint32 slotMask;
+    int32 * slots;
+    E164TopKCounter * counters;
+} E164TopK;
+
+/*
+ * The serialized form of the aggregate state, only ever read back by the
+ * same server.
+ */
+typedef struct E164TopKSummary
+{
+    int32 vl_len_;
+    int32 k;
+    int32 numberOfCounters;
+    int32 reserved;
+    E164TopKCounter counters[FLEXIBLE_ARRAY_MEMBER];
+} E164TopKSummary;
+
+#define E164TopKSummarySize(numberOfCounters) \
+    (offsetof(E164TopKSummary, counters) \
+     + (Size) (numberOfCounters) * sizeof(E164TopKCounter))
+
+Datum e164_topk_transfn(PG_FUNCTION_ARGS);
+Datum e164_topk_finalfn(PG_FUNCTION_ARGS);
+Datum e164_topk_combinefn(PG_FUNCTION_ARGS);
+Datum e164_topk_serialfn(PG_FUNCTION_ARGS);
+Datum e164_topk_deserialfn(PG_FUNCTION_ARGS);
+
+static E164TopK * newTopK(MemoryContext aContext, int32 k);
+static int32 topKFind(const E164TopK * aTopK, E164 aNumber);
+static void topKInsertSlot(E164TopK * aTopK, int32 position);
+static void topKDeleteSlot(E164TopK * aTopK, int32 aSlot);
+static void topKSwap(E164TopK * aTopK, int32 i, int32 j);
+static void topKSiftUp(E164TopK * aTopK, int32 position);
+static void topKSiftDown(E164TopK * aTopK, int32 position);
+static void topKAppend(E164TopK * aTopK, E164 aNumber, int64 count,
+                       int64 error);
+static void topKAdd(E164TopK * aTopK, E164 aNumber);
+static int64 topKMinimum(const E164TopK * aTopK);
+static void topKMerge(E164TopK * aTopK, const E164TopK * anotherTopK);
+static int  compareCounters(const void * a, const void * b);
+
+
+static E164TopK *
+newTopK(MemoryContext aContext, int32 k)
+{
+    E164TopK * theTopK;
+    uint32 numberOfSlots = 1;
+
+    if (k < 1 || k > E164TopKMaximumK)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of top numbers must be between 1 and %d",
+                        E164TopKMaximumK)));
+
+    theTopK = MemoryContextAlloc(aContext, sizeof(E164TopK));
+    theTopK->k = k;
+    theTopK->capacity = k * E164TopKCounterFactor;
+    theTopK->numberOfCounters = 0;
+    while (numberOfSlots < 2 * (uint32) theTopK->capacity)
+        numberOfSlots <<= 1;
+    theTopK->slotMask = numberOfSlots - 1;
+    theTopK->slots = MemoryContextAlloc(aContext, numberOfSlots * sizeof(int32));
+    memset(theTopK->slots, -1, numberOfSlots * sizeof(int32));
+    theTopK->counters = MemoryContextAlloc(aContext,
+                                           theTopK->capacity * sizeof(E164TopKCounter));
+    return theTopK;
+}
+
+/*
+ * topKFind returns the slot of the counter of aNumber, or -1.
+ */
+static int32
+topKFind(const E164TopK * aTopK, E164 aNumber)
+{
+    uint32 theSlot = e164Hash(aNumber) & aTopK->slotMask;
+
+    while (aTopK->slots[theSlot] >= 0)
+    {
+        if (0 == e164Comparison(aTopK->counters[aTopK->slots[theSlot]].number,
+                                aNumber))
+            return theSlot;
+        theSlot = (theSlot + 1) & aTopK->slotMask;
+    }
+    return -1;
+}
+
+static void
+topKInsertSlot(E164TopK * aTopK, int32 position)
+{
+    uint32 theSlot = e164Hash(aTopK->counters[position].number) & aTopK->slotMask;
+
+    while (aTopK->slots[theSlot] >= 0)
+        theSlot = (theSlot + 1) & aTopK->slotMask;
+    aTopK->slots[theSlot] = position;
+    aTopK->counters[position].slot = theSlot;
+}
+
+/*
+ * topKDeleteSlot empties aSlot, moving back any following entry whose
+ * probe sequence passes through it, so that no tombstones are needed.
+ */
+static void
+topKDeleteSlot(E164TopK * aTopK, int32 aSlot)
+{
+    uint32 theHole = aSlot;
+    uint32 theSlot = aSlot;
+
+    for (;;)
+    {
+        uint32 theHome;
+
+        theSlot = (theSlot + 1) & aTopK->slotMask;
+        if (aTopK->slots[theSlot] < 0)
+            break;
+        theHome = e164Hash(aTopK->counters[aTopK->slots[theSlot]].number)
+            & aTopK->slotMask;
+        /* Leave the entry if its home lies cyclically in (theHole, theSlot] */
+        if (((theSlot - theHome) & aTopK->slotMask) <
+            ((theSlot - theHole) & aTopK->slotMask))
+            continue;
+        aTopK->slots[theHole] = aTopK->slots[theSlot];
+        aTopK->counters[aTopK->slots[theHole]].slot = theHole;
+        theHole = theSlot;
+    }
+    aTopK->slots[theHole] = -1;
+}
+
+static void
+topKSwap(E164TopK * aTopK, int32 i, int32 j)
+{
+    E164TopKCounter theCounter = aTopK->counters[i];
+
+    aTopK->counters[i] = aTopK->counters[j];
+    aTopK->counters[j] = theCounter;
+    aTopK->slots[aTopK->counters[i].slot] = i;
+    aTopK->slots[aTopK->counters[j].slot] = j;
+}
+
+static void
+topKSiftUp(E164TopK * aTopK, int32 position)
+{
+    while (position > 0)
+    {
+        int32 theParent = (position - 1) / 2;
+
+        if (aTopK->counters[theParent].count <= aTopK->counters[position].count)
+            break;
+        topKSwap(aTopK, theParent, position);
+        position = theParent;
+    }
+}
+
+static void
+topKSiftDown(E164TopK * aTopK, int32 position)
+{
+    for (;;)
+    {
+        int32 theSmallest = position;
+        int32 theChild = 2 * position + 1;
+
+        if (theChild < aTopK->numberOfCounters &&
+            aTopK->counters[theChild].count < aTopK->counters[theSmallest].count)
+            theSmallest = theChild;
+        theChild++;
+        if (theChild < aTopK->numberOfCounters &&
+            aTopK->counters[theChild].count < aTopK->counters[theSmallest].count)
+            theSmallest = theChild;
+        if (theSmallest == position)
+            break;
+        topKSwap(aTopK, position, theSmallest);
+        position = theSmallest;
+    }
+}
+
+static void
+topKAppend(E164TopK * aTopK, E164 aNumber, int64 count, int64 error)
+{
+    int32 thePosition = aTopK->numberOfCounters++;
+
+    aTopK->counters[thePosition].number = aNumber;
+    aTopK->counters[thePosition].count = count;
+    aTopK->counters[thePosition].error = error;
+    topKInsertSlot(aTopK, thePosition);
+    topKSiftUp(aTopK, thePosition);
+}
+
+static void
+topKAdd(E164TopK * aTopK, E164 aNumber)
+{
+    int32 theSlot = topKFind(aTopK, aNumber);
+
+    if (theSlot >= 0)
+    {
+        int32 thePosition = aTopK->slots[theSlot];
+
+        aTopK->counters[thePosition].count++;
+        topKSiftDown(aTopK, thePosition);
+    }
+    else if (aTopK->numberOfCounters < aTopK->capacity)
+        topKAppend(aTopK, aNumber, 1, 0);
+    else
+    {
+        E164TopKCounter * theSmallest = &aTopK->counters[0];
+
+        topKDeleteSlot(aTopK, theSmallest->slot);
+        theSmallest->number = aNumber;
+        theSmallest->error = theSmallest->count;
+        theSmallest->count++;
+        topKInsertSlot(aTopK, 0);
+        topKSiftDown(aTopK, 0);
+    }
+}
+
+/*
+ * topKMinimum returns the count any number without a counter may have
+ * had: 0 while some counters are free, the smallest count otherwise.
+ */
+static int64
+topKMinimum(const E164TopK * aTopK)
+{
+    if (aTopK->numberOfCounters < aTopK->capacity)
+        return 0;
+    return aTopK->counters[0].count;
+}
+
+/*
+ * topKMerge merges anotherTopK into aTopK, as in Agarwal et al.,
+ * "Mergeable Summaries": a number missing from one summary is given that
+ * summary's minimum as both count and error, and the largest counters of
+ * the sum are kept.
+ */
+static void
+topKMerge(E164TopK * aTopK, const E164TopK * anotherTopK)
+{
+    int64 theMinimum = topKMinimum(aTopK);
+    int64 theOtherMinimum = topKMinimum(anotherTopK);
+    int32 numberOfCounters = 0;
+    E164TopKCounter * theCounters;
+    bool * merged;
+    int32 i;
+
+    if (aTopK->k != anotherTopK->k)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of top numbers must be the same for every row")));
+
+    theCounters = palloc((aTopK->numberOfCounters + anotherTopK->numberOfCounters)
+                         * sizeof(E164TopKCounter));
+    merged = palloc0(anotherTopK->numberOfCounters * sizeof(bool));
+    for (i = 0; i < aTopK->numberOfCounters; i++)
+    {
+        E164TopKCounter * theCounter = &theCounters[numberOfCounters++];
+        int32 theSlot = topKFind(anotherTopK, aTopK->counters[i].number);
+
+        *theCounter = aTopK->counters[i];
+        if (theSlot >= 0)
+        {
+            int32 thePosition = anotherTopK->slots[theSlot];
+
+            theCounter->count += anotherTopK->counters[thePosition].count;
+            theCounter->error += anotherTopK->counters[thePosition].error;
+            merged[thePosition] = true;
+        }
+        else
+        {
+            theCounter->count += theOtherMinimum;
+            theCounter->error += theOtherMinimum;
+        }
+    }
+    for (i = 0; i < anotherTopK->numberOfCounters; i++)
+    {
+        if (!merged[i])
+        {
+            E164TopKCounter * theCounter = &theCounters[numberOfCounters++];
+
+            *theCounter = anotherTopK->counters[i];
+            theCounter->count += theMinimum;
+            theCounter->error += theMinimum;
+        }
+    }
+
+    qsort(theCounters, numberOfCounters, sizeof(E164TopKCounter), compareCounters);
+    memset(aTopK->slots, -1, (aTopK->slotMask + 1) * sizeof(int32));
+    aTopK->numberOfCounters = 0;
+    for (i = 0; i < Min(numberOfCounters, aTopK->capacity); i++)
+        topKAppend(aTopK, theCounters[i].number, theCounters[i].count,
+                   theCounters[i].error);
+
+    pfree(merged);
+    pfree(theCounters);
+}
+
+/*
+ * compareCounters orders counters by decreasing count, then by number.
+ */
+static int
+compareCounters(const void * a, const void * b)
+{
+    const E164TopKCounter * theFirst = a;
+    const E164TopKCounter * theSecond = b;
+    int64 theComparison;
+
+    if (theFirst->count != theSecond->count)
+        return (theFirst->count > theSecond->count) ? -1 : 1;
+    theComparison = e164Comparison(theFirst->number, theSecond->number);
+    return (theComparison > 0) - (theComparison < 0);
+}
+
+PG_FUNCTION_INFO_V1(e164_topk_transfn);
+Datum
+e164_topk_transfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164TopK * theTopK;
+    int32 k;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_topk_transfn called in non-aggregate context");
+    if (PG_ARGISNULL(2))
+        ereport(ERROR,
+                (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                 errmsg("number of top numbers must not be null")));
+    k = PG_GETARG_INT32(2);
+
+    if (PG_ARGISNULL(0))
+        theTopK = newTopK(aggContext, k);
+    else
+    {
+        theTopK = (E164TopK *) PG_GETARG_POINTER(0);
+        if (theTopK->k != k)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("number of top numbers must be the same for every row")));
+    }
+
+    if (!PG_ARGISNULL(1))
+        topKAdd(theTopK, PG_GETARG_E164(1));
+    PG_RETURN_POINTER(theTopK);
+}
+
+/*
+ * e164_topk_finalfn returns the k largest counters as an array of
+ * e164_topk_entry, by decreasing count.
+ */
+PG_FUNCTION_INFO_V1(e164_topk_finalfn);
+Datum
+e164_topk_finalfn(PG_FUNCTION_ARGS)
+{
+    E164TopK * theTopK;
+    E164TopKCounter * theCounters;
+    Oid theEntryType;
+    TupleDesc theDescriptor;
+    int16 theEntryLength;
+    bool theEntryByValue;
+    char theEntryAlignment;
+    Datum * theEntries;
+    int32 numberOfEntries;
+    int32 i;
+
+    if (PG_ARGISNULL(0))
+        PG_RETURN_NULL();
+    theTopK = (E164TopK *) PG_GETARG_POINTER(0);
+
+    theEntryType = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+    if (!OidIsValid(theEntryType))
+        elog(ERROR, "could not determine the e164_topk_entry type");
+    theDescriptor = lookup_rowtype_tupdesc(theEntryType, -1);
+    get_typlenbyvalalign(theEntryType, &theEntryLength, &theEntryByValue,
+                         &theEntryAlignment);
+
+    theCounters = palloc(theTopK->numberOfCounters * sizeof(E164TopKCounter));
+    memcpy(theCounters, theTopK->counters,
+           theTopK->numberOfCounters * sizeof(E164TopKCounter));
+    qsort(theCounters, theTopK->numberOfCounters, sizeof(E164TopKCounter),
+          compareCounters);
+
+    numberOfEntries = Min(theTopK->k, theTopK->numberOfCounters);
+    theEntries = palloc(numberOfEntries * sizeof(Datum));
+    for (i = 0; i < numberOfEntries; i++)
+    {
+        Datum values[3];
+        bool nulls[3] = {false, false, false};
+
+        values[0] = E164PGetDatum(theCounters[i].number);
+        values[1] = Int64GetDatum(theCounters[i].count);
+        values[2] = Int64GetDatum(theCounters[i].error);
+        theEntries[i] = HeapTupleGetDatum(heap_form_tuple(theDescriptor,
+                                                          values, nulls));
+    }
+    ReleaseTupleDesc(theDescriptor);
+
+    PG_RETURN_ARRAYTYPE_P(construct_array(theEntries, numberOfEntries,
+                                          theEntryType, theEntryLength,
+                                          theEntryByValue, theEntryAlignment));
+}
+
+PG_FUNCTION_INFO_V1(e164_topk_combinefn);
+Datum
+e164_topk_combinefn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164TopK * theTopK;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_topk_combinefn called in non-aggregate context");
+
+    if (PG_ARGISNULL(1))
+    {
+        if (PG_ARGISNULL(0))
+            PG_RETURN_NULL();
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    if (PG_ARGISNULL(0))
+    {
+        E164TopK * theOtherTopK = (E164TopK *) PG_GETARG_POINTER(1);
+
+        theTopK = newTopK(aggContext, theOtherTopK->k);
+        topKMerge(theTopK, theOtherTopK);
+        PG_RETURN_POINTER(theTopK);
+    }
+
+    theTopK = (E164TopK *) PG_GETARG_POINTER(0);
+    topKMerge(theTopK, (E164TopK *) PG_GETARG_POINTER(1));
+    PG_RETURN_POINTER(theTopK);
+}
+
+PG_FUNCTION_INFO_V1(e164_topk_serialfn);
+Datum
+e164_topk_serialfn(PG_FUNCTION_ARGS)
+{
+    E164TopK * theTopK = (E164TopK *) PG_GETARG_POINTER(0);
+    E164TopKSummary * theSummary =
+        palloc0(E164TopKSummarySize(theTopK->numberOfCounters));
+
+    SET_VARSIZE(theSummary, E164TopKSummarySize(theTopK->numberOfCounters));
+    theSummary->k = theTopK->k;
+    theSummary->numberOfCounters = theTopK->numberOfCounters;
+    memcpy(theSummary->counters, theTopK->counters,
+           theTopK->numberOfCounters * sizeof(E164TopKCounter));
+    PG_RETURN_BYTEA_P(theSummary);
+}
+
+PG_FUNCTION_INFO_V1(e164_topk_deserialfn);
+Datum
+e164_topk_deserialfn(PG_FUNCTION_ARGS)
+{
+    MemoryContext aggContext;
+    E164TopKSummary * theSummary;
+    E164TopK * theTopK;
+    int32 i;
+
+    if (!AggCheckCallContext(fcinfo, &aggContext))
+        elog(ERROR, "e164_topk_deserialfn called in non-aggregate context");
+
+    /*
+     * The serialized state is a bytea, which is only int-aligned, while the
+     * counters hold int64 fields: copy it into aligned memory before
+     * reading it.
+     */
+    theSummary = (E164TopKSummary *) PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(0));
+    theTopK = newTopK(aggContext, theSummary->k);
+    for (i = 0; i < theSummary->numberOfCounters; i++)
+        topKAppend(theTopK, theSummary->counters[i].number,
+                   theSummary->counters[i].count,
+                   theSummary->counters[i].error);
+    PG_RETURN_POINTER(theTopK);
+}
@@ -217,3 +217,742 @@ SELECT CAST('+123456789012' AS e164);
 SELECT CAST('+1234567890123' AS e164);
 SELECT CAST('+12345678901234' AS e164);
 SELECT CAST('+123456789012345' AS e164);
+
+-- GiST index: exclusion constraints and nearest-number searches
+CREATE TABLE allocated_numbers
+(
+    telephone_number e164
+    , EXCLUDE USING gist (telephone_number WITH =)
+);
+
+INSERT INTO allocated_numbers (telephone_number)
+VALUES ('+14155550100'), ('+14155550107'), ('+14155550150'),
+       ('+14155559999'), ('+442073779923');
+INSERT INTO allocated_numbers (telephone_number) VALUES ('+14155550107');
+
+SET enable_seqscan = off;
+SELECT telephone_number
+    , telephone_number <-> '+14155550105' AS distance
+FROM allocated_numbers
+ORDER BY telephone_number <-> '+14155550105'
+LIMIT 3;
+RESET enable_seqscan;
+
+DROP TABLE allocated_numbers;
+
+-- Ranges of numbers
+SELECT e164range('+14155550000', '+14155550999', '[]');
+SELECT e164range('+1999', '+1999', '[]');
+SELECT e164range('+14155550000', '+14155550999', '[]')
+    = e164range('+14155550000', '+14155551000') AS canonical;
+
+CREATE TABLE number_blocks
+(
+    block e164range
+    , EXCLUDE USING gist (block WITH &&)
+);
+
+INSERT INTO number_blocks (block)
+VALUES ('[+14155550000,+14155550999]'), ('[+14155551000,+14155551999]');
+INSERT INTO number_blocks (block) VALUES ('[+14155550900,+14155551099]');
+
+SELECT block
+FROM number_blocks
+WHERE block @> CAST('+14155551234' AS e164);
+
+DROP TABLE number_blocks;
+
+-- BRIN indexes
+CREATE TABLE call_records
+(
+    caller e164
+);
+
+INSERT INTO call_records (caller)
+SELECT CAST('+1415555' || lpad(CAST(i AS text), 4, '0') AS e164)
+FROM generate_series(0, 999) AS i;
+
+CREATE INDEX call_records_minmax_idx
+ON call_records USING brin
+(caller);
+CREATE INDEX call_records_minmax_multi_idx
+ON call_records USING brin
+(caller brin_e164_minmax_multi_ops);
+CREATE INDEX call_records_bloom_idx
+ON call_records USING brin
+(caller brin_e164_bloom_ops);
+
+SET enable_seqscan = off;
+SELECT count(*) FROM call_records WHERE caller = '+14155550123';
+SELECT count(*) FROM call_records WHERE caller > '+14155550990';
+RESET enable_seqscan;
+
+DROP TABLE call_records;
+
+-- GIN indexes over arrays of numbers
+CREATE TABLE contacts
+(
+    id INTEGER PRIMARY KEY
+    , telephone_numbers e164[]
+);
+
+INSERT INTO contacts (id, telephone_numbers)
+VALUES (1, '{+14155550100,+442073779923}')
+     , (2, '{+14155550101}')
+     , (3, '{+442073779923,+35312121220}');
+
+CREATE INDEX contacts_telephone_numbers_idx
+ON contacts USING gin
+(telephone_numbers);
+
+SET enable_seqscan = off;
+SELECT id FROM contacts
+WHERE telephone_numbers @> CAST('+442073779923' AS e164)
+ORDER BY id;
+SELECT id FROM contacts
+WHERE CAST('+14155550101' AS e164) <@ telephone_numbers
+ORDER BY id;
+SELECT id FROM contacts
+WHERE telephone_numbers && CAST('{+14155550101,+35312121220}' AS e164[])
+ORDER BY id;
+RESET enable_seqscan;
+
+DROP TABLE contacts;
+
+-- Digit pattern searches
+CREATE TABLE suspicious_numbers
+(
+    id INTEGER PRIMARY KEY
+    , telephone_number e164 NOT NULL
+);
+
+INSERT INTO suspicious_numbers (id, telephone_number)
+VALUES (1, '+14155550123')
+     , (2, '+18005550199')
+     , (3, '+18885550100')
+     , (4, '+442073779923')
+     , (5, '+35312121220');
+
+CREATE INDEX suspicious_numbers_digits_idx
+ON suspicious_numbers USING gin
+(telephone_number gin_e164_digit_ops);
+
+SET enable_seqscan = off;
+SELECT id FROM suspicious_numbers
+WHERE telephone_number ~# '%5550%'
+ORDER BY id;
+SELECT id FROM suspicious_numbers
+WHERE telephone_number ~# '+1 8?? 555 01??'
+ORDER BY id;
+SELECT id FROM suspicious_numbers
+WHERE telephone_number ~# '+44 (20) %'
+ORDER BY id;
+SELECT id FROM suspicious_numbers
+WHERE telephone_number ~# '%0'
+ORDER BY id;
+SELECT id FROM suspicious_numbers
+WHERE telephone_number ~# '%'
+ORDER BY id;
+RESET enable_seqscan;
+
+SELECT CAST('+14155550123' AS e164) ~# '+1 415 555 012';
+SELECT CAST('+14155550123' AS e164) ~# '1415555x123';
+
+DROP TABLE suspicious_numbers;
+
+-- Suffix matching
+CREATE TABLE callers
+(
+    id INTEGER PRIMARY KEY
+    , telephone_number e164 NOT NULL
+);
+
+INSERT INTO callers (id, telephone_number)
+VALUES (1, '+14155550123')
+     , (2, '+442074155550123')
+     , (3, '+14155550124')
+     , (4, '+3531234');
+
+CREATE INDEX callers_suffix_idx
+ON callers (e164_suffix(telephone_number, 10));
+
+SET enable_seqscan = off;
+SELECT id FROM callers
+WHERE e164_has_suffix(telephone_number, '4155550123')
+ORDER BY id;
+RESET enable_seqscan;
+
+SELECT e164_suffix('+14155550123', 7), e164_suffix('+3531234', 10);
+SELECT e164_has_suffix('+3531234', '0003531234') IS TRUE
+     , e164_has_suffix('+3531234', '3531234');
+SELECT e164_suffix('+14155550123', 0);
+
+DROP TABLE callers;
+
+-- Bloom hashing
+SELECT e164_bloom_hash('+14155550123') = e164_bloom_hash('+1 415 555 0123')
+     , e164_bloom_hash('+14155550123') = e164_bloom_hash('+14155550124');
+
+SELECT EXISTS (SELECT 1 FROM pg_am WHERE amname = 'bloom') =
+       EXISTS (SELECT 1 FROM pg_opclass WHERE opcname = 'bloom_e164_ops')
+       AS bloom_ops_if_bloom;
+DO $$
+DECLARE
+    theCount bigint;
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_opclass WHERE opcname = 'bloom_e164_ops') THEN
+        CREATE TEMPORARY TABLE bloom_numbers (telephone_number e164);
+        INSERT INTO bloom_numbers (telephone_number)
+        SELECT CAST(14155550000 + i AS e164) FROM generate_series(0, 999) AS i;
+        CREATE INDEX bloom_numbers_idx ON bloom_numbers
+        USING bloom (telephone_number);
+        SET LOCAL enable_seqscan = off;
+        SELECT count(*) INTO theCount FROM bloom_numbers
+        WHERE telephone_number = '+14155550123';
+        IF theCount <> 1 THEN
+            RAISE EXCEPTION 'bloom index scan found % numbers', theCount;
+        END IF;
+        DROP TABLE bloom_numbers;
+    END IF;
+END
+$$;
+
+-- Compact storage
+CREATE TABLE compact_numbers
+(
+    telephone_number e164c PRIMARY KEY
+);
+
+INSERT INTO compact_numbers (telephone_number)
+VALUES ('+19995550123')
+     , ('+4420')
+     , ('+14155550123')
+     , (CAST('+35312121220' AS e164));
+
+SELECT telephone_number FROM compact_numbers ORDER BY telephone_number;
+SELECT pg_column_size(telephone_number) FROM compact_numbers LIMIT 1;
+
+SET enable_seqscan = off;
+SELECT telephone_number FROM compact_numbers
+WHERE telephone_number = '+14155550123';
+SELECT count(*) FROM compact_numbers
+WHERE telephone_number > CAST('+19000000000' AS e164);
+RESET enable_seqscan;
+
+DROP TABLE compact_numbers;
+
+-- Country code sets
+SELECT CAST(' { 353, 1 ,44 } ' AS ccset);
+SELECT CAST('{1,44}' AS ccset) @> CAST('+442073779923' AS e164)
+     , CAST('+35312121220' AS e164) <@ CAST('{1,44}' AS ccset)
+     , CAST('{1,44}' AS ccset) && CAST('{44,353}' AS ccset)
+     , CAST('{1,44,353}' AS ccset) @> CAST('{44,353}' AS ccset)
+     , CAST('{1}' AS ccset) <@ CAST('{44,353}' AS ccset);
+SELECT CAST('{0}' AS ccset);
+SELECT CAST('{1,}' AS ccset);
+
+CREATE TABLE tenant_calls
+(
+    tenant INTEGER
+    , destination e164
+    , CHECK (CAST('{1,44}' AS ccset) @> destination)
+);
+
+INSERT INTO tenant_calls (tenant, destination)
+VALUES (1, '+14155550123')
+     , (1, '+442073779923')
+     , (2, '+14155550124');
+INSERT INTO tenant_calls (tenant, destination)
+VALUES (2, '+35312121220');
+
+SELECT tenant, ccset_agg(destination)
+FROM tenant_calls
+GROUP BY tenant
+ORDER BY tenant;
+SELECT ccset_union_agg(countries)
+FROM (SELECT ccset_agg(destination) FROM tenant_calls GROUP BY tenant)
+     AS t(countries);
+
+DROP TABLE tenant_calls;
+
+-- Number sets
+SELECT CAST('{+442073779923, +1 415 555 0123,+14155550123}' AS e164set);
+SELECT CAST('{}' AS e164set);
+SELECT CAST('{+14155550123,}' AS e164set);
+
+CREATE TABLE do_not_call
+(
+    telephone_number e164
+);
+
+INSERT INTO do_not_call (telephone_number)
+SELECT CAST('+1415555' || lpad(CAST(n AS text), 4, '0') AS e164)
+FROM generate_series(0, 9999, 2) AS n;
+INSERT INTO do_not_call (telephone_number)
+VALUES ('+442073779923'), ('+35312121220');
+
+CREATE TABLE registry AS
+SELECT e164set_agg(telephone_number) AS numbers FROM do_not_call;
+
+SELECT e164set_cardinality(numbers) FROM registry;
+SELECT numbers @> CAST('+14155550124' AS e164)
+     , numbers @> CAST('+14155550123' AS e164)
+     , CAST('+442073779923' AS e164) <@ numbers
+FROM registry;
+SELECT e164set_cardinality(numbers | '{+14155550123,+14155550124}')
+     , e164set_cardinality(numbers - '{+14155550124,+442073779923}')
+FROM registry;
+SELECT numbers & '{+14155550123,+14155550124,+35312121220}'
+FROM registry;
+
+DROP TABLE registry;
+DROP TABLE do_not_call;
+
+-- Bloom filters
+CREATE TABLE seen_numbers AS
+SELECT CAST('+1415555' || lpad(CAST(n AS text), 4, '0') AS e164) AS telephone_number
+FROM generate_series(0, 999) AS n;
+
+CREATE TABLE filters AS
+SELECT e164_bloom_agg(telephone_number, 16384, 5) AS filter
+FROM seen_numbers;
+
+SELECT length(filter) FROM filters;
+SELECT count(*) FROM seen_numbers, filters
+WHERE NOT e164_bloom_contains(filter, telephone_number);
+SELECT e164_bloom_contains(filter, '+14155550999')
+FROM filters;
+SELECT e164_bloom_contains(e164_bloom_union(filter, filter), '+14155550500')
+FROM filters;
+SELECT e164_bloom_union(filter, e164_bloom_agg(telephone_number, 8192, 5))
+FROM filters, seen_numbers
+GROUP BY filter;
+
+DROP TABLE filters;
+DROP TABLE seen_numbers;
+
+-- HyperLogLog distinct counts
+CREATE TABLE dialed_numbers AS
+SELECT CAST('+1415555' || lpad(CAST(n % 1000 AS text), 4, '0') AS e164) AS telephone_number
+     , n % 2 AS hour
+FROM generate_series(0, 2999) AS n;
+
+SELECT e164_hll(telephone_number), e164_hll(telephone_number, 10)
+FROM dialed_numbers;
+SELECT hour, e164_hll(telephone_number)
+FROM dialed_numbers
+GROUP BY hour
+ORDER BY hour;
+
+CREATE TABLE sketches AS
+SELECT hour, e164_hll_sketch(telephone_number) AS sketch
+FROM dialed_numbers
+GROUP BY hour;
+
+SELECT length(sketch) FROM sketches WHERE hour = 0;
+SELECT e164_hll_cardinality(e164_hll_union_agg(sketch)) FROM sketches;
+SELECT e164_hll_cardinality(e164_hll_union(a.sketch, b.sketch))
+FROM sketches AS a, sketches AS b
+WHERE a.hour = 0 AND b.hour = 1;
+SELECT e164_hll(telephone_number, 3) FROM dialed_numbers;
+SELECT e164_hll_cardinality('\x0102');
+
+DROP TABLE sketches;
+DROP TABLE dialed_numbers;
+
+-- Heavy hitters
+CREATE TABLE calls AS
+SELECT CAST('+1415555000' || CAST(n AS text) AS e164) AS caller
+FROM generate_series(1, 9) AS n, generate_series(1, n) AS r;
+
+SELECT * FROM unnest((SELECT e164_topk(caller, 3) FROM calls));
+SELECT * FROM unnest((SELECT e164_topk(caller, 1) FROM calls));
+SELECT e164_topk(caller, 0) FROM calls;
+
+DROP TABLE calls;
+
+-- Country code histograms
+CREATE TABLE routed_calls AS
+SELECT CAST(n AS e164) AS callee
+FROM (VALUES ('+14155550123'), ('+442073779923'), ('+14155550124')
+           , ('+35312121220'), ('+19995550123')) AS v (n);
+
+SELECT * FROM unnest((SELECT e164_cc_histogram(callee) FROM routed_calls));
+SELECT e164_cc_histogram(callee) FROM routed_calls WHERE false;
+
+DROP TABLE routed_calls;
+
+-- Number blocks
+CREATE TABLE inventory AS
+SELECT CAST('+1415555' || lpad(CAST(n AS text), 4, '0') AS e164) AS telephone_number
+FROM generate_series(100, 199) AS n
+UNION ALL
+SELECT CAST('+1415555' || lpad(CAST(n AS text), 4, '0') AS e164)
+FROM generate_series(150, 250) AS n
+UNION ALL
+VALUES (CAST('+14155550300' AS e164))
+     , (CAST('+442073779923' AS e164))
+     , (CAST('+442073779924' AS e164));
+
+SELECT * FROM unnest((SELECT e164_blocks_agg(telephone_number)
+                      FROM inventory));
+
+DROP TABLE inventory;
+
+-- Parallel aggregation
+CREATE TABLE parallel_numbers AS
+SELECT CAST('+1415555' || lpad(CAST(n AS text), 4, '0') AS e164) AS telephone_number
+FROM generate_series(0, 9999) AS n;
+ALTER TABLE parallel_numbers SET (parallel_workers = 2);
+ANALYZE parallel_numbers;
+
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+
+EXPLAIN (COSTS OFF)
+SELECT min(telephone_number), max(telephone_number)
+FROM parallel_numbers;
+SELECT min(telephone_number), max(telephone_number)
+FROM parallel_numbers;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM parallel_numbers
+WHERE telephone_number < '+14155555000';
+SELECT count(*) FROM parallel_numbers
+WHERE telephone_number < '+14155555000';
+
+RESET max_parallel_workers_per_gather;
+RESET min_parallel_table_scan_size;
+RESET parallel_tuple_cost;
+RESET parallel_setup_cost;
+
+SELECT min(telephone_number), max(telephone_number)
+FROM parallel_numbers WHERE false;
+
+DROP TABLE parallel_numbers;
+
+-- Comparisons with int8 and text
+SELECT CAST('+14155550123' AS e164) = 14155550123
+     , CAST('+4420' AS e164) > 19995550123
+     , 14155550123 <> CAST('+14155550123' AS e164)
+     , CAST('+14155550123' AS e164) = CAST('+14155550123' AS text)
+     , CAST('+1 415 555 0123' AS text) = CAST('+14155550123' AS e164);
+
+CREATE TABLE legacy_numbers AS
+SELECT CAST(n AS bigint) AS digits, '+' || CAST(n AS text) AS raw
+FROM (VALUES (14155550123), (442073779923), (35312121220)) AS v (n);
+
+CREATE TABLE carrier_numbers AS
+SELECT CAST('+1415555' || lpad(CAST(n AS text), 4, '0') AS e164) AS telephone_number
+     , n AS line
+FROM generate_series(0, 9999) AS n;
+INSERT INTO carrier_numbers VALUES ('+442073779923', 0);
+CREATE INDEX carrier_numbers_telephone_number_idx
+ON carrier_numbers (telephone_number);
+ANALYZE carrier_numbers;
+ANALYZE legacy_numbers;
+
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+EXPLAIN (COSTS OFF)
+SELECT line FROM carrier_numbers
+WHERE telephone_number = 14155550123;
+SELECT line FROM carrier_numbers
+WHERE telephone_number = 14155550123;
+SELECT count(*) FROM carrier_numbers
+WHERE telephone_number >= 14155559990
+  AND telephone_number < 442000000000;
+RESET enable_bitmapscan;
+RESET enable_seqscan;
+
+SET enable_nestloop = off;
+SET enable_mergejoin = off;
+SELECT l.digits, c.telephone_number
+FROM legacy_numbers AS l
+JOIN carrier_numbers AS c ON c.telephone_number = l.digits
+ORDER BY l.digits;
+SELECT l.raw, c.telephone_number
+FROM legacy_numbers AS l
+JOIN carrier_numbers AS c ON c.telephone_number = l.raw
+ORDER BY l.raw;
+RESET enable_mergejoin;
+RESET enable_nestloop;
+
+DROP TABLE carrier_numbers;
+DROP TABLE legacy_numbers;
+
+-- Integer constructors and casts
+SELECT e164_from_parts(1, 4155550123)
+     , e164_from_parts(39, 612345678, 10)
+     , CAST(442073779923 AS e164)
+     , CAST(CAST('+35312121220' AS e164) AS bigint);
+SELECT e164_from_parts(2, 12345);
+SELECT e164_from_parts(0, 12345);
+SELECT e164_from_parts(1, 12345, 3);
+SELECT e164_from_parts(1, 4155550123, 15);
+SELECT CAST(-14155550123 AS e164);
+SELECT CAST(CAST(4 AS bigint) AS e164);
+
+-- Arithmetic and series
+SELECT CAST('+14155550100' AS e164) + 99
+     , 99 + CAST('+14155550100' AS e164)
+     , CAST('+14155550100' AS e164) - 100
+     , CAST('+14155550199' AS e164) - CAST('+14155550100' AS e164);
+SELECT CAST('+19999999999' AS e164) + 1;
+SELECT CAST('+10000000000' AS e164) - 1;
+SELECT CAST('+14155550100' AS e164) - CAST('+442073779923' AS e164);
+SELECT CAST('+14155550100' AS e164) + 90000000000;
+SELECT CAST('+104155550100' AS e164) - CAST('+14155550100' AS e164);
+SELECT * FROM generate_series(CAST('+14155550100' AS e164),
+                              CAST('+14155550103' AS e164));
+SELECT * FROM generate_series(CAST('+14155550200' AS e164),
+                              CAST('+14155550100' AS e164), -40);
+SELECT count(*) FROM generate_series(CAST('+14155550000' AS e164),
+                                     CAST('+14155559999' AS e164), 10);
+SELECT * FROM generate_series(CAST('+14155550103' AS e164),
+                              CAST('+14155550100' AS e164));
+SELECT * FROM generate_series(CAST('+14155550100' AS e164),
+                              CAST('+14155550103' AS e164), 0);
+SELECT * FROM generate_series(CAST('+14155550100' AS e164),
+                              CAST('+442073779923' AS e164));
+
+-- Window RANGE frames and btree support functions
+SELECT n
+     , count(*) OVER (ORDER BY n RANGE BETWEEN 100 PRECEDING AND 100 FOLLOWING)
+     , min(n) OVER (ORDER BY n RANGE BETWEEN 50 PRECEDING AND CURRENT ROW)
+FROM (VALUES (CAST('+14155550100' AS e164)), ('+14155550150'), ('+14155550199'),
+             ('+14155550201'), ('+14155550400'), ('+442073779923')) AS t (n)
+ORDER BY n;
+SELECT n
+     , count(*) OVER (ORDER BY n DESC RANGE BETWEEN 100 PRECEDING AND CURRENT ROW)
+FROM (VALUES (CAST('+14155550100' AS e164)), ('+14155550150'), ('+14155550199'),
+             ('+14155550201'), ('+14155550400'), ('+442073779923')) AS t (n)
+ORDER BY n;
+SELECT n
+     , count(*) OVER (ORDER BY n RANGE BETWEEN CURRENT ROW
+                                        AND 1000000000000000 FOLLOWING) AS near
+     , count(*) OVER (ORDER BY n RANGE BETWEEN CURRENT ROW
+                                        AND 100000000000000000 FOLLOWING) AS far
+     , count(*) OVER (ORDER BY n RANGE BETWEEN 9223372036854775807 PRECEDING
+                                        AND CURRENT ROW) AS saturated
+FROM (VALUES (CAST('+14155550100' AS e164)), ('+19995550100'),
+             ('+33123450000'), ('+442073779923')) AS t (n)
+ORDER BY n;
+SELECT count(*) OVER (ORDER BY n RANGE BETWEEN -1 PRECEDING AND CURRENT ROW)
+FROM (VALUES (CAST('+14155550100' AS e164))) AS t (n);
+SELECT amprocnum, amproclefttype::regtype, amprocrighttype::regtype, amproc
+FROM pg_amproc
+WHERE amprocfamily = (SELECT oid FROM pg_opfamily
+                      WHERE opfname = 'btree_e164_ops')
+  AND amprocnum IN (3, 4)
+ORDER BY amprocnum;
+
+-- Planner statistics
+CREATE TABLE planner_numbers
+(
+    telephone_number e164 NOT NULL
+);
+
+INSERT INTO planner_numbers (telephone_number)
+SELECT CAST(14155550000 + i AS e164) FROM generate_series(0, 6999) AS i
+UNION ALL
+SELECT CAST(442070000000 + i AS e164) FROM generate_series(0, 1999) AS i
+UNION ALL
+SELECT CAST(35312120000 + i AS e164) FROM generate_series(0, 999) AS i;
+
+CREATE TABLE roaming_numbers
+(
+    telephone_number e164 NOT NULL
+);
+
+INSERT INTO roaming_numbers (telephone_number)
+SELECT CAST(33123450000 + i AS e164) FROM generate_series(0, 499) AS i;
+
+ANALYZE planner_numbers;
+ANALYZE roaming_numbers;
+
+SELECT stakind1, stakind2, stakind3, stavalues3, stanumbers3
+FROM pg_statistic
+WHERE starelid = CAST('planner_numbers' AS regclass);
+
+CREATE FUNCTION pg_temp.estimated_rows(query text)
+RETURNS bigint
+LANGUAGE plpgsql AS $$
+DECLARE
+    plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (FORMAT JSON) ' || query INTO plan;
+    RETURN plan->0->'Plan'->>'Plan Rows';
+END
+$$;
+
+SELECT pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE telephone_number <@ CAST('{44}' AS ccset)$$) AS gb
+     , pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE CAST('{1,353}' AS ccset) @> telephone_number$$) AS nanp_ie
+     , pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE telephone_number <@ CAST('{33}' AS ccset)$$) AS fr;
+SELECT pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE telephone_number ^@ '+44'$$) AS cc
+     , pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE telephone_number ^@ '+3'$$) AS short
+     , pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE telephone_number ^@ '+1 415 555'$$) AS exchange
+     , pg_temp.estimated_rows($$SELECT * FROM planner_numbers
+                      WHERE telephone_number ^@ '+1 415 555 1'$$) AS thousand;
+SELECT pg_temp.estimated_rows($$SELECT * FROM planner_numbers AS p
+                      JOIN planner_numbers AS q
+                      ON p.telephone_number = q.telephone_number$$) AS same
+     , pg_temp.estimated_rows($$SELECT * FROM planner_numbers AS p
+                      JOIN roaming_numbers AS r
+                      ON p.telephone_number = r.telephone_number$$) AS disjoint;
+
+SELECT count(*) FROM planner_numbers
+WHERE telephone_number ^@ '+1 415 555 1';
+SELECT CAST('+14155550123' AS e164) ^@ '+1 415 x';
+
+CREATE INDEX planner_numbers_digits_idx
+ON planner_numbers USING gin
+(telephone_number gin_e164_digit_ops);
+
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM planner_numbers
+WHERE telephone_number ^@ '+44 20 7000 1';
+SELECT count(*) FROM planner_numbers
+WHERE telephone_number ^@ '+44 20 7000 1';
+RESET enable_seqscan;
+
+DROP TABLE planner_numbers;
+DROP TABLE roaming_numbers;
+
+-- Partitioning by country code
+SELECT country_code_int(CAST('+442073779923' AS e164))
+     , country_code_lower_bound(44)
+     , country_code_upper_bound(44)
+     , country_code_upper_bound(1)
+     , country_code_upper_bound(998);
+SELECT country_code_lower_bound(2);
+SELECT country_code_upper_bound(999);
+
+CREATE TABLE cdrs
+(
+    telephone_number e164 NOT NULL
+    , seconds INTEGER NOT NULL
+) PARTITION BY LIST (country_code_int(telephone_number));
+
+CREATE TABLE cdrs_nanp PARTITION OF cdrs FOR VALUES IN (1);
+CREATE TABLE cdrs_gb PARTITION OF cdrs FOR VALUES IN (44);
+CREATE TABLE cdrs_other PARTITION OF cdrs DEFAULT;
+
+INSERT INTO cdrs (telephone_number, seconds)
+VALUES ('+14155550123', 60)
+     , ('+442073779923', 120)
+     , ('+442079460000', 45)
+     , ('+35312121220', 30);
+
+EXPLAIN (COSTS OFF)
+SELECT sum(seconds) FROM cdrs
+WHERE country_code_int(telephone_number) = 44;
+SELECT sum(seconds) FROM cdrs
+WHERE country_code_int(telephone_number) = 44;
+
+CREATE TABLE cdrs_by_number
+(
+    telephone_number e164 NOT NULL
+) PARTITION BY RANGE (telephone_number);
+
+CREATE TABLE cdrs_by_number_nanp PARTITION OF cdrs_by_number
+FOR VALUES FROM (country_code_lower_bound(1))
+TO (country_code_upper_bound(1));
+CREATE TABLE cdrs_by_number_gb PARTITION OF cdrs_by_number
+FOR VALUES FROM (country_code_lower_bound(44))
+TO (country_code_upper_bound(44));
+
+SELECT pg_get_expr(relpartbound, oid) FROM pg_class
+WHERE relname = 'cdrs_by_number_gb';
+
+INSERT INTO cdrs_by_number (telephone_number)
+SELECT telephone_number FROM cdrs
+WHERE country_code_int(telephone_number) IN (1, 44);
+
+EXPLAIN (COSTS OFF)
+SELECT * FROM cdrs_by_number
+WHERE telephone_number = '+442073779923';
+SELECT tableoid::regclass, telephone_number FROM cdrs_by_number
+ORDER BY telephone_number;
+
+DROP TABLE cdrs;
+DROP TABLE cdrs_by_number;
+
+-- Extended hashing and shard routing
+SELECT telephone_number
+     , e164_shard(telephone_number, 64) AS shard
+     , e164_shard(telephone_number, 1) AS single
+FROM (VALUES (CAST('+14155550123' AS e164)), ('+442073779923'),
+             ('+35312121220'), ('+18005550199')) AS t (telephone_number);
+SELECT count(*) FILTER (WHERE e164_shard(n, 64) <> e164_shard(n, 63)) AS moved
+     , bool_and(e164_shard(n, 64) IN (e164_shard(n, 63), 63)) AS to_new_shard
+     , bool_and(e164_shard(n, 64, 42) IN (e164_shard(n, 63, 42), 63))
+         AS to_new_shard_seeded
+     , bool_and((e164_hash_extended(n, 0) & 4294967295) =
+                (e164_hash(n) & 4294967295)) AS extends_hash
+FROM (SELECT CAST(14155550000 + i AS e164)
+      FROM generate_series(0, 9999) AS i) AS t (n);
+SELECT min(count), max(count)
+FROM (SELECT count(*)
+      FROM generate_series(0, 9999) AS i
+      GROUP BY e164_shard(CAST(14155550000 + i AS e164), 64)) AS t;
+SELECT e164_shard(CAST('+14155550123' AS e164), 0);
+
+CREATE TABLE hashed_numbers
+(
+    telephone_number e164 NOT NULL
+) PARTITION BY HASH (telephone_number);
+
+CREATE TABLE hashed_numbers_0 PARTITION OF hashed_numbers
+FOR VALUES WITH (MODULUS 2, REMAINDER 0);
+CREATE TABLE hashed_numbers_1 PARTITION OF hashed_numbers
+FOR VALUES WITH (MODULUS 2, REMAINDER 1);
+
+INSERT INTO hashed_numbers (telephone_number)
+SELECT CAST(14155550000 + i AS e164) FROM generate_series(0, 999) AS i;
+
+SELECT count(DISTINCT tableoid) AS partitions, count(*)
+FROM hashed_numbers;
+SELECT count(*) FROM hashed_numbers
+WHERE telephone_number = '+14155550123';
+
+DROP TABLE hashed_numbers;
+
+-- Pseudonymization and tokenization
+SELECT n, e164_pseudonymize(n, k), e164_tokenize(n, k)
+     , e164_detokenize(e164_tokenize(n, k), k)
+FROM (VALUES (CAST('+14155550123' AS e164)), ('+442073779923'),
+             ('+390612345678'), ('+35312121220'), ('+2901234')) AS t (n)
+   , (VALUES (CAST('\x000102030405060708090a0b0c0d0e0f' AS bytea))) AS s (k);
+SELECT e164_pseudonymize(n, k), e164_tokenize(n, k)
+FROM (VALUES (CAST('+442070000000' AS e164),
+              CAST('\x0f0e0d0c0b0a09080706050403020100' AS bytea))) AS t (n, k);
+SELECT count(DISTINCT e164_pseudonymize(n, k)) AS pseudonyms
+     , count(DISTINCT e164_tokenize(n, k)) AS tokens
+     , bool_and(country_code_int(e164_tokenize(n, k)) = 44 AND
+                e164_digits(e164_tokenize(n, k)) >= 440000000000)
+         AS same_country_code_and_length
+     , bool_and(e164_detokenize(e164_tokenize(n, k), k) = n) AS round_trip
+     , bool_and(e164_tokenize(n, k) <> e164_tokenize(n, k2)) AS keyed
+FROM generate_series(CAST('+442070000000' AS e164), '+442070009999') AS t (n)
+   , (VALUES (CAST('\x000102030405060708090a0b0c0d0e0f' AS bytea),
+              CAST('\x0f0e0d0c0b0a09080706050403020100' AS bytea))) AS s (k, k2);
+SELECT e164_pseudonymize('+14155550123', CAST('\x00' AS bytea));
+
+-- Prefix metadata lookups, without e164 in shared_preload_libraries
+SELECT e164_lookup('+14155550123', 'region');
+SELECT e164_lookup('+14155550123', 'country');
+SELECT e164_prefix_reload();
+SHOW e164.prefix_memory;
+SELECT proname, provolatile, proparallel
+FROM pg_proc
+WHERE proname IN ('e164_lookup', 'e164_prefix_reload')
+ORDER BY proname;
@@ -0,0 +1,52 @@
+-- E164 prefix lookup regression test SQL script
+-- Run by "make check-prefix" against a server started with e164_prefix.conf
+
+SET search_path = public;
+\set ECHO none
+SET client_min_messages = warning;
+\i e164.sql
+RESET client_min_messages;
+\set ECHO all
+\set VERBOSITY terse
+
+SET SEARCH_PATH to public, e164;
+
+-- e164.prefix_file is relative to the data directory
+SELECT current_setting('data_directory') || '/e164_prefixes.tsv' AS prefix_file
+\gset
+
+COPY (VALUES ('# prefix, carrier, region and time zone', '', '', '')
+           , ('+1', '', 'North America', '')
+           , ('+1415', 'Example Telecom', 'California', 'America/Los_Angeles')
+           , ('+1415555', 'Example Mobile', '', '')
+           , ('+44', '', 'United Kingdom', 'Europe/London')
+           , ('+4420', 'Example Telecom', 'London', ''))
+TO :'prefix_file';
+
+-- Undefined attributes fall back to the longest shorter prefix defining them
+SELECT n
+     , e164_lookup(n, 'carrier') AS carrier
+     , e164_lookup(n, 'region') AS region
+     , e164_lookup(n, 'timezone') AS timezone
+FROM (VALUES (CAST('+14155550123' AS e164)), ('+14152220123'), ('+12125550123'),
+             ('+442073779923'), ('+441612345678'), ('+35312121220')) AS t (n);
+
+SELECT e164_lookup('+14155550123', 'network');
+
+-- A changed file is picked up by a reload
+COPY (VALUES ('+1415', 'Other Telecom', 'California', 'America/Los_Angeles')
+           , ('+44', '', 'United Kingdom', 'Europe/London'))
+TO :'prefix_file';
+SELECT e164_prefix_reload();
+
+SELECT n
+     , e164_lookup(n, 'carrier') AS carrier
+     , e164_lookup(n, 'region') AS region
+FROM (VALUES (CAST('+14155550123' AS e164)), ('+12125550123'),
+             ('+442073779923')) AS t (n);
+
+-- A file which fails to load leaves the previous snapshot in use
+COPY (VALUES ('+1415', 'Broken Telecom'), ('+14x', 'Broken Telecom'))
+TO :'prefix_file';
+SELECT e164_prefix_reload();
+SELECT e164_lookup('+14155550123', 'carrier');